@@ -0,0 +1,218 @@
+// aliasing and cost of the band-limiting options for saw, square and triangle:
+// naive analytic shapes, PolyBLEP/PolyBLAMP, wavetables and the naive shapes at 4x oversampling
+// (rendered at 4·fs, then a 255-tap windowed-sinc decimator). run a release build, e.g.
+//   aliasing_bench [sample_rate]
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+#include "notes.h"
+#include "voice_bank.h"
+
+namespace
+{
+    constexpr int fft_size   = 1 << 15;
+    constexpr int block_size = 64;
+    constexpr int oversample = 4;
+    constexpr int fir_taps   = 255;
+
+    using Buffer = std::vector<float, simd::AlignedAllocator<float>>;
+    using RenderBlock = std::function<void(VoiceBank&, float*, int)>;
+
+    enum class Method { Naive, PolyBlep, Wavetable, Oversampled };
+    const char* methodName(Method m)
+    {
+        switch (m)
+        {
+        case Method::Naive:       return "naive";
+        case Method::PolyBlep:    return "polyblep";
+        case Method::Wavetable:   return "wavetable";
+        case Method::Oversampled: return "naive 4x";
+        }
+        return "";
+    }
+
+    // windowed-sinc lowpass just under the target Nyquist, at the oversampled rate
+    std::vector<float> decimationFilter()
+    {
+        std::vector<float> taps(fir_taps);
+        const double cutoff = 0.45 / oversample; // cycles per oversampled sample
+        double sum = 0.0;
+        for (int n = 0; n < fir_taps; ++n)
+        {
+            const double m = n - (fir_taps - 1) / 2.0;
+            const double sinc = (m == 0.0) ? 2.0 * cutoff : std::sin(two_pi_d * cutoff * m) / (two_pi_d * 0.5 * m);
+            const double x = two_pi_d * n / (fir_taps - 1);
+            const double window = 0.35875 - 0.48829 * std::cos(x) + 0.14128 * std::cos(2 * x) - 0.01168 * std::cos(3 * x);
+            taps[n] = static_cast<float>(sinc * window);
+            sum += taps[n];
+        }
+        for (auto& t : taps)
+            t = static_cast<float>(t / sum);
+        return taps;
+    }
+
+    template <WaveformType W>
+    RenderBlock renderer(Method method, const Wavetables& wavetables)
+    {
+        switch (method)
+        {
+        case Method::PolyBlep:
+            return [](VoiceBank& bank, float* mix, int n) { bank.render(mix, n, PolyBlepOscillator<W>{}); };
+        case Method::Wavetable:
+            return [&wavetables](VoiceBank& bank, float* mix, int n) { bank.render(mix, n, wavetables.oscillator(W)); };
+        default:
+            return [](VoiceBank& bank, float* mix, int n) { bank.render(mix, n, AnalyticOscillator<W>{}); };
+        }
+    }
+
+    // renders num_samples of `voices` voices (voice 0 at `frequency`) at the output rate
+    Buffer render(const RenderBlock& block, Method method, int voices, float frequency,
+                  double sample_rate, int num_samples, const std::vector<float>& fir)
+    {
+        const int factor = (method == Method::Oversampled) ? oversample : 1;
+        VoiceBank bank(voices);
+        bank.setEnvelope({ 0.0f, 0.0f, 1.0f, 0.0f }); // flat, so no envelope sidebands end up in the spectrum
+        bank.setSampleRate(sample_rate * factor);
+        for (int v = 0; v < voices; ++v)
+            bank.start(v, v, frequency * (1.0f + 0.013f * v));
+
+        const int internal = num_samples * factor + (factor > 1 ? fir_taps : 0);
+        Buffer raw(static_cast<std::size_t>((internal + block_size - 1) / block_size * block_size), 0.0f);
+        for (int at = 0; at < internal; at += block_size)
+            block(bank, raw.data() + at, block_size);
+
+        if (factor == 1)
+        {
+            raw.resize(static_cast<std::size_t>(num_samples));
+            return raw;
+        }
+
+        Buffer out(static_cast<std::size_t>(num_samples));
+        for (int n = 0; n < num_samples; ++n)
+        {
+            const float* x = raw.data() + n * factor;
+            float acc = 0.0f;
+            for (int k = 0; k < fir_taps; ++k)
+                acc += fir[k] * x[k];
+            out[n] = acc;
+        }
+        return out;
+    }
+
+    void fft(std::vector<std::complex<double>>& a)
+    {
+        const std::size_t n = a.size();
+        for (std::size_t i = 1, j = 0; i < n; ++i)
+        {
+            std::size_t bit = n >> 1;
+            for (; j & bit; bit >>= 1)
+                j ^= bit;
+            j ^= bit;
+            if (i < j)
+                std::swap(a[i], a[j]);
+        }
+        for (std::size_t len = 2; len <= n; len <<= 1)
+        {
+            const std::complex<double> w_len = std::polar(1.0, -two_pi_d / static_cast<double>(len));
+            for (std::size_t i = 0; i < n; i += len)
+            {
+                std::complex<double> w = 1.0;
+                for (std::size_t k = 0; k < len / 2; ++k, w *= w_len)
+                {
+                    const auto u = a[i + k];
+                    const auto v = a[i + k + len / 2] * w;
+                    a[i + k] = u + v;
+                    a[i + k + len / 2] = u - v;
+                }
+            }
+        }
+    }
+
+    struct Aliasing
+    {
+        double total_db; // everything off the harmonics, relative to the harmonics
+        double peak_db;  // loudest single off-harmonic bin, relative to the fundamental
+    };
+
+    // Blackman-Harris windowed spectrum; bins within a few bins of a harmonic below Nyquist count as signal
+    Aliasing measure(const Buffer& x, double frequency, double sample_rate)
+    {
+        std::vector<std::complex<double>> spectrum(fft_size);
+        for (int n = 0; n < fft_size; ++n)
+        {
+            const double t = two_pi_d * n / (fft_size - 1);
+            const double window = 0.35875 - 0.48829 * std::cos(t) + 0.14128 * std::cos(2 * t) - 0.01168 * std::cos(3 * t);
+            spectrum[n] = x[n] * window;
+        }
+        fft(spectrum);
+
+        const double bin_hz = sample_rate / fft_size;
+        const int guard = 5; // main lobe of the window
+        double signal = 0.0, alias = 0.0, peak_alias = 0.0, fundamental = 0.0;
+        for (int bin = guard; bin < fft_size / 2; ++bin)
+        {
+            const double power = std::norm(spectrum[bin]);
+            const double harmonic = std::round(bin * bin_hz / frequency);
+            const bool on_harmonic = harmonic >= 1.0 && std::abs(bin - harmonic * frequency / bin_hz) <= guard;
+            if (on_harmonic)
+            {
+                signal += power;
+                if (harmonic == 1.0)
+                    fundamental = std::max(fundamental, power);
+            }
+            else
+            {
+                alias += power;
+                peak_alias = std::max(peak_alias, power);
+            }
+        }
+        return { 10.0 * std::log10(alias / signal), 10.0 * std::log10(peak_alias / fundamental) };
+    }
+
+    double nsPerSample(const RenderBlock& block, Method method, int voices, double sample_rate, const std::vector<float>& fir)
+    {
+        const int num_samples = static_cast<int>(sample_rate) / 4;
+        const auto start = std::chrono::steady_clock::now();
+        const auto out = render(block, method, voices, 440.0f, sample_rate, num_samples, fir);
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return out.empty() ? 0.0 : elapsed * 1e9 / num_samples;
+    }
+
+    template <WaveformType W>
+    void benchWaveform(const char* name, double sample_rate, const Wavetables& wavetables, const std::vector<float>& fir)
+    {
+        for (auto method : { Method::Naive, Method::PolyBlep, Method::Wavetable, Method::Oversampled })
+        {
+            const auto block = renderer<W>(method, wavetables);
+            std::printf("%-9s %-10s", name, methodName(method));
+            for (float frequency : { C5, C6, C7 })
+            {
+                const auto a = measure(render(block, method, 1, frequency, sample_rate, fft_size, fir), frequency, sample_rate);
+                std::printf(" %8.1f %8.1f", a.total_db, a.peak_db);
+            }
+            std::printf(" %9.2f %9.2f\n", nsPerSample(block, method, 1, sample_rate, fir), nsPerSample(block, method, 64, sample_rate, fir));
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const double sample_rate = argc > 1 ? std::atof(argv[1]) : 48000.0;
+
+    Wavetables wavetables;
+    wavetables.build(sample_rate);
+    const auto fir = decimationFilter();
+
+    std::printf("simd: %s, %.0f Hz, %d-point Blackman-Harris FFT\n", simd::isa_name, sample_rate, fft_size);
+    std::printf("aliasing in dB: total off-harmonic power vs harmonics / loudest alias vs fundamental\n");
+    std::printf("%-9s %-10s %17s %17s %17s %9s %9s\n", "waveform", "method", "C5 total/peak", "C6 total/peak", "C7 total/peak", "ns 1v", "ns 64v");
+
+    benchWaveform<WaveformType::Sawtooth>("sawtooth", sample_rate, wavetables, fir);
+    benchWaveform<WaveformType::Square>("square", sample_rate, wavetables, fir);
+    benchWaveform<WaveformType::Triangle>("triangle", sample_rate, wavetables, fir);
+    return 0;
+}
@@ -0,0 +1,121 @@
+// ns per output sample of the inverse-FFT bank (SpectralBank, one inverse FFT per hop for everything)
+// against time-domain partials (AdditiveBank, a SIMD recursive oscillator per partial), for a growing
+// number of sounding partials and every frame size; then where each frame size starts to win. run a
+// release build, e.g.
+//   spectral_bench [block_size]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <vector>
+#include "additive.h"
+#include "spectral_bank.h"
+
+namespace
+{
+    constexpr double sample_rate = 48000.0;
+    constexpr double min_seconds = 0.05; // per measurement
+    constexpr int frame_sizes[] = { 256, 512, 1024, 2048 };
+    constexpr AdsrParams flat = { 0.0f, 0.0f, 1.0f, 0.25f }; // held at full level for the whole run
+
+    struct Load
+    {
+        int voices;
+        int partials; // per voice, at most AdditiveBank::max_partials
+    };
+    constexpr Load loads[] = { { 1, 4 }, { 1, 16 }, { 1, 64 }, { 1, 256 }, { 4, 256 }, { 16, 256 }, { 64, 256 } };
+
+    // partials at 1/k over a low note, so all of them are under Nyquist
+    Spectrum harmonics(int count)
+    {
+        Spectrum spectrum;
+        for (int k = 1; k <= count; ++k)
+            spectrum.add(static_cast<float>(k), 1.0f / static_cast<float>(k));
+        spectrum.normalize();
+        return spectrum;
+    }
+
+    float voiceFrequency(int v)
+    {
+        // spread voices a little so no two line up
+        return 40.0f * (1.0f + 0.013f * static_cast<float>(v));
+    }
+
+    template <typename Render>
+    double nsPerSample(Render&& render, int block_size)
+    {
+        for (int i = 0; i < 64; ++i) // untimed warm-up
+            render();
+
+        using clock = std::chrono::steady_clock;
+        long long samples = 0;
+        const auto start = clock::now();
+        double elapsed = 0.0;
+        do
+        {
+            for (int i = 0; i < 64; ++i)
+                render();
+            samples += 64LL * block_size;
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < min_seconds);
+        return elapsed * 1e9 / static_cast<double>(samples);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int block_size = argc > 1 ? std::max(1, std::atoi(argv[1])) : 256;
+    std::printf("simd: %s (%d lanes), block size %d, %.0f Hz\n", simd::isa_name, simd::width, block_size, sample_rate);
+    std::printf("%8s %8s %12s", "voices", "partials", "additive ns");
+    for (int frame_size : frame_sizes)
+        std::printf("   fft %-5d", frame_size);
+    std::printf("\n");
+
+    std::vector<float, simd::AlignedAllocator<float>> mix(static_cast<std::size_t>(block_size));
+    constexpr int num_frame_sizes = static_cast<int>(std::size(frame_sizes));
+    int crossover[num_frame_sizes];
+    std::fill(std::begin(crossover), std::end(crossover), 0);
+
+    for (const Load& load : loads)
+    {
+        const Spectrum spectrum = harmonics(load.partials);
+        const int total = load.voices * load.partials;
+
+        AdditiveBank additive;
+        additive.prepare(sample_rate, load.voices, flat);
+        for (int v = 0; v < load.voices; ++v)
+            additive.noteOn(v, voiceFrequency(v), spectrum);
+        const double additive_ns = nsPerSample([&] {
+            std::fill(mix.begin(), mix.end(), 0.0f);
+            additive.render(mix.data(), block_size);
+        }, block_size);
+        std::printf("%8d %8d %12.2f", load.voices, total, additive_ns);
+
+        for (int f = 0; f < num_frame_sizes; ++f)
+        {
+            SpectralBank spectral;
+            spectral.prepare(sample_rate, load.voices, flat, frame_sizes[f]);
+            for (int v = 0; v < load.voices; ++v)
+                spectral.noteOn(v, voiceFrequency(v), spectrum);
+            const double spectral_ns = nsPerSample([&] {
+                std::fill(mix.begin(), mix.end(), 0.0f);
+                spectral.render(mix.data(), block_size);
+            }, block_size);
+            std::printf("   %9.2f", spectral_ns);
+            if (crossover[f] == 0 && spectral_ns < additive_ns)
+                crossover[f] = total;
+        }
+        std::printf("\n");
+    }
+
+    std::printf("\nfewest partials where the inverse FFT is faster:\n");
+    for (int f = 0; f < num_frame_sizes; ++f)
+    {
+        if (crossover[f] > 0)
+            std::printf("  frame %-5d (hop %4d = %4.1f ms)  %d\n", frame_sizes[f], frame_sizes[f] / 4, 1000.0 * frame_sizes[f] / 4 / sample_rate, crossover[f]);
+        else
+            std::printf("  frame %-5d  never, up to %d\n", frame_sizes[f], loads[std::size(loads) - 1].voices * loads[std::size(loads) - 1].partials);
+    }
+    return 0;
+}
@@ -0,0 +1,336 @@
+// microbenchmarks of the engine's hot paths, written as JSON so runs can be diffed across commits:
+//   render      ns per output sample of SynthEngine::process for every waveform, 1/10/64/256 held voices
+//               and blocks of 16..2048, next to the original per-sample getNextAudioBlock loop
+//   note_churn  ns per note-on/note-off through the voice allocator, with free voices and with stealing
+//   timer_tick  ns per 60 Hz UI tick spent draining played melody notes into the key animation state,
+//               over the whole of a small, a medium and a large melody
+// e.g.
+//   synth_bench [--json results.json] [--label abc123] [--min-time 0.02]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "melodies.h"
+#include "synth_engine.h"
+
+namespace
+{
+    constexpr double sample_rate = 48000.0;
+    double min_seconds = 0.02; // per measurement
+
+    float voiceFrequency(int v)
+    {
+        // spread voices over E3..C7 so phases don't line up
+        return 164.81f + static_cast<float>((v * 7919) % 1929);
+    }
+
+    const char* waveformName(WaveformType waveform)
+    {
+        switch (waveform)
+        {
+        case WaveformType::Sine:     return "sine";
+        case WaveformType::Sawtooth: return "sawtooth";
+        case WaveformType::Square:   return "square";
+        default:                     return "triangle";
+        }
+    }
+
+    // runs body until min_seconds have passed; ns per unit of work, body returns the units it did
+    template <typename Body>
+    double nsPer(Body&& body)
+    {
+        using clock = std::chrono::steady_clock;
+        long long units = 0;
+        const auto start = clock::now();
+        double elapsed = 0.0;
+        do
+        {
+            units += body();
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < min_seconds);
+        return elapsed * 1e9 / static_cast<double>(units);
+    }
+
+    // the audio callback as it was before the voice bank: every slot, every sample, a switch on the
+    // waveform and an fmod per voice. kept as the baseline the engine is measured against
+    void baselineGetNextAudioBlock(std::vector<Note>& active_notes, WaveformType waveform, float* left, float* right, int num_samples)
+    {
+        for (int sample = 0; sample < num_samples; ++sample)
+        {
+            float mix_sample = 0.0f;
+
+            for (auto& voice : active_notes)
+            {
+                if (voice.is_active || voice.amplitude > 0.0f)
+                {
+                    switch (waveform)
+                    {
+                    case WaveformType::Sine:
+                        mix_sample += voice.amplitude * std::sin(voice.phase);
+                        break;
+                    case WaveformType::Sawtooth:
+                        mix_sample += voice.amplitude * ((voice.phase / pi_f) - 1.0f);
+                        break;
+                    case WaveformType::Square:
+                        mix_sample += voice.amplitude * ((voice.phase < pi_f) ? 0.5f : -0.5f);
+                        break;
+                    case WaveformType::Triangle:
+                        mix_sample += voice.amplitude * (std::abs((voice.phase / pi_f) - 1.0f) * 2.0f - 1.0f);
+                        break;
+                    }
+
+                    voice.phase_delta = static_cast<float>(two_pi_d * voice.frequency / sample_rate);
+                    voice.phase = static_cast<float>(std::fmod(voice.phase + voice.phase_delta, two_pi_d));
+
+                    if (!voice.is_active)
+                    {
+                        voice.amplitude -= 0.001f;
+                        if (voice.amplitude < 0.0f)
+                            voice.amplitude = 0.0f;
+                    }
+                }
+            }
+
+            left[sample] = mix_sample * SynthEngine::output_gain;
+            right[sample] = left[sample];
+        }
+    }
+
+    class Json
+    {
+    public:
+        void add(const std::string& object) { entries.push_back(object); }
+
+        void write(std::FILE* out, const std::string& label) const
+        {
+            std::fprintf(out, "{\n  \"label\": \"%s\",\n  \"simd\": \"%s\",\n  \"lanes\": %d,\n  \"sample_rate\": %.0f,\n  \"results\": [\n",
+                         label.c_str(), simd::isa_name, simd::width, sample_rate);
+            for (std::size_t i = 0; i < entries.size(); ++i)
+                std::fprintf(out, "    %s%s\n", entries[i].c_str(), i + 1 < entries.size() ? "," : "");
+            std::fprintf(out, "  ]\n}\n");
+        }
+
+    private:
+        std::vector<std::string> entries;
+    };
+
+    std::string format(const char* pattern, ...)
+    {
+        char text[512];
+        va_list args;
+        va_start(args, pattern);
+        std::vsnprintf(text, sizeof(text), pattern, args);
+        va_end(args);
+        return text;
+    }
+
+    void benchRender(Json& json)
+    {
+        std::printf("%-9s %6s %6s %12s %12s %9s\n", "waveform", "voices", "block", "engine ns", "baseline ns", "speedup");
+        for (auto waveform : { WaveformType::Sine, WaveformType::Sawtooth, WaveformType::Square, WaveformType::Triangle })
+        {
+            for (int voices : { 1, 10, 64, 256 })
+            {
+                for (int block_size = 16; block_size <= 2048; block_size *= 2)
+                {
+                    std::vector<float> left(static_cast<std::size_t>(block_size));
+                    std::vector<float> right(static_cast<std::size_t>(block_size));
+                    float* channels[2] = { left.data(), right.data() };
+
+                    SynthEngine engine(voices);
+                    engine.setWaveform(waveform);
+                    engine.prepare(sample_rate, block_size);
+                    for (int v = 0; v < voices; ++v)
+                        engine.pushNoteEvent({ NoteEvent::Type::NoteOn, v, voiceFrequency(v), 0 });
+                    engine.process(channels, 2, block_size);
+
+                    std::vector<Note> baseline(static_cast<std::size_t>(voices));
+                    for (int v = 0; v < voices; ++v)
+                    {
+                        baseline[v].frequency = voiceFrequency(v);
+                        baseline[v].is_active = true;
+                    }
+
+                    const double engine_ns = nsPer([&] {
+                        for (int i = 0; i < 16; ++i)
+                            engine.process(channels, 2, block_size);
+                        return 16LL * block_size;
+                    });
+                    const double baseline_ns = nsPer([&] {
+                        for (int i = 0; i < 16; ++i)
+                            baselineGetNextAudioBlock(baseline, waveform, left.data(), right.data(), block_size);
+                        return 16LL * block_size;
+                    });
+
+                    std::printf("%-9s %6d %6d %12.2f %12.2f %8.2fx\n", waveformName(waveform), voices, block_size,
+                                engine_ns, baseline_ns, baseline_ns / engine_ns);
+                    json.add(format("{\"case\": \"render\", \"waveform\": \"%s\", \"voices\": %d, \"block\": %d, "
+                                    "\"engine_ns_per_sample\": %.3f, \"baseline_ns_per_sample\": %.3f}",
+                                    waveformName(waveform), voices, block_size, engine_ns, baseline_ns));
+                }
+            }
+        }
+    }
+
+    // random note-ons and note-offs over 128 keys; with fewer voices than keys most note-ons steal
+    void benchChurn(Json& json)
+    {
+        std::printf("\n%-16s %10s %12s\n", "policy", "polyphony", "ns per event");
+        for (auto [policy, policy_name] : { std::pair{ StealPolicy::Oldest, "oldest" }, std::pair{ StealPolicy::Quietest, "quietest" },
+                                            std::pair{ StealPolicy::LowestPriority, "lowest_priority" }, std::pair{ StealPolicy::SameKey, "same_key" } })
+        {
+            for (int polyphony : { 16, 64, 256 })
+            {
+                VoiceBank bank;
+                VoiceAllocator voices{ bank };
+                voices.resize(polyphony);
+                voices.setSampleRate(sample_rate);
+                voices.setStealPolicy(policy);
+
+                std::mt19937 random(1);
+                std::vector<uint8_t> held(128, 0);
+                std::vector<int> keys(4096);
+                for (int& key : keys)
+                    key = static_cast<int>(random() % 128);
+
+                const double ns = nsPer([&] {
+                    for (int key : keys)
+                    {
+                        if (held[key])
+                            voices.noteOff(key);
+                        else
+                            voices.noteOn(key, voiceFrequency(key), key & 1);
+                        held[key] ^= 1;
+                    }
+                    voices.reclaim();
+                    return static_cast<long long>(keys.size());
+                });
+
+                std::printf("%-16s %10d %12.2f\n", policy_name, polyphony, ns);
+                json.add(format("{\"case\": \"note_churn\", \"policy\": \"%s\", \"polyphony\": %d, \"ns_per_event\": %.3f}",
+                                policy_name, polyphony, ns));
+            }
+        }
+    }
+
+    struct KeyAnimation
+    {
+        bool is_lit = false;
+        float splash_radius = 0.0f;
+        float splash_opacity = 0.0f;
+    };
+
+    // the engine-facing part of Synth::timerCallback: advance the splashes, then light and unlight keys
+    // for every melody note played since the last tick. the repaint itself is JUCE's and not measured
+    void timerTick(SynthEngine& engine, std::map<int, KeyAnimation>& keys)
+    {
+        for (auto& [key, animation] : keys)
+        {
+            if (animation.splash_opacity > 0.0f)
+            {
+                animation.splash_radius += 1.5f;
+                animation.splash_opacity -= 0.02f;
+            }
+        }
+
+        NoteEvent event;
+        while (engine.popPlayedEvent(event))
+        {
+            auto& animation = keys[event.key_code];
+            animation.is_lit = event.type == NoteEvent::Type::NoteOn;
+            if (animation.is_lit)
+            {
+                animation.splash_radius = 0.0f;
+                animation.splash_opacity = 1.0f;
+            }
+        }
+        engine.takeFinished();
+    }
+
+    void benchTimer(Json& json)
+    {
+        std::printf("\n%-18s %6s %12s\n", "melody", "notes", "ns per tick");
+        const auto note_map = keyboardNoteMap();
+        for (const char* wanted : { "melody_jazz", "melody_ddlc", "melody_symphony" })
+        {
+            for (const auto& melody : melodyCatalog())
+            {
+                if (wanted != std::string(melody.name))
+                    continue;
+
+                constexpr int tick_samples = static_cast<int>(sample_rate) / 60;
+                std::vector<float> left(tick_samples);
+                float* channels[1] = { left.data() };
+
+                SynthEngine engine;
+                const int score = engine.addScore(CompiledScore(melody.notes, note_map));
+                engine.prepare(sample_rate, tick_samples);
+                std::map<int, KeyAnimation> keys;
+                for (const auto& [key, note] : note_map)
+                    keys[key] = {};
+
+                // audio for one tick, then the tick, over the whole melody; only the ticks are timed
+                using clock = std::chrono::steady_clock;
+                double tick_secs = 0.0;
+                long long ticks = 0;
+                do
+                {
+                    engine.pushSequencerCommand({ SequencerCommand::Type::Play, score, 0.0, 0.0, melody.tempo, melody.transpose });
+                    do
+                    {
+                        engine.process(channels, 1, tick_samples);
+                        const auto start = clock::now();
+                        timerTick(engine, keys);
+                        tick_secs += std::chrono::duration<double>(clock::now() - start).count();
+                        ++ticks;
+                    } while (engine.isMelodyPlaying());
+                } while (tick_secs < min_seconds);
+
+                const double ns = tick_secs * 1e9 / static_cast<double>(ticks);
+                std::printf("%-18s %6zu %12.2f\n", melody.name, engine.score(score).numNotes(), ns);
+                json.add(format("{\"case\": \"timer_tick\", \"melody\": \"%s\", \"notes\": %zu, \"ns_per_tick\": %.3f}",
+                                melody.name, engine.score(score).numNotes(), ns));
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string json_path = "synth_bench.json";
+    std::string label;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--json")
+            json_path = argv[i + 1];
+        else if (arg == "--label")
+            label = argv[i + 1];
+        else if (arg == "--min-time")
+            min_seconds = std::max(0.001, std::atof(argv[i + 1]));
+    }
+
+    std::printf("simd: %s (%d lanes), %.0f Hz\n", simd::isa_name, simd::width, sample_rate);
+
+    Json json;
+    benchRender(json);
+    benchChurn(json);
+    benchTimer(json);
+
+    std::FILE* out = std::fopen(json_path.c_str(), "w");
+    if (out == nullptr)
+    {
+        std::fprintf(stderr, "can't write %s\n", json_path.c_str());
+        return 1;
+    }
+    json.write(out, label);
+    std::fclose(out);
+    std::printf("\nwrote %s\n", json_path.c_str());
+    return 0;
+}
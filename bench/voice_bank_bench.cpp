@@ -0,0 +1,91 @@
+// ns per output sample of the SoA/SIMD voice bank (analytic and wavetable oscillators)
+// against the scalar per-voice loop, for a growing number of held voices. run a release build, e.g.
+//   voice_bank_bench [block_size]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "voice_bank.h"
+
+namespace
+{
+    constexpr double sample_rate = 48000.0;
+    constexpr double min_seconds = 0.05; // per measurement
+
+    float voiceFrequency(int v)
+    {
+        // spread voices over E3..C7 so phases don't line up
+        return 164.81f + static_cast<float>((v * 7919) % 1929);
+    }
+
+    template <typename Render>
+    double nsPerSample(Render&& render, int block_size)
+    {
+        using clock = std::chrono::steady_clock;
+        long long samples = 0;
+        const auto start = clock::now();
+        double elapsed = 0.0;
+        do
+        {
+            for (int i = 0; i < 64; ++i)
+                render();
+            samples += 64LL * block_size;
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < min_seconds);
+        return elapsed * 1e9 / static_cast<double>(samples);
+    }
+
+    template <WaveformType W>
+    void benchWaveform(const char* name, int block_size, const Wavetables& wavetables)
+    {
+        std::vector<float, simd::AlignedAllocator<float>> mix(static_cast<std::size_t>(block_size));
+
+        for (int voices : { 1, 4, 10, 16, 32, 64, 128, 256, 512 })
+        {
+            std::vector<Note> scalar(static_cast<std::size_t>(voices));
+            VoiceBank bank(voices);
+            bank.setSampleRate(sample_rate);
+            for (int v = 0; v < voices; ++v)
+            {
+                scalar[v].frequency = voiceFrequency(v);
+                scalar[v].amplitude = 1.0f;
+                scalar[v].is_active = true;
+                bank.start(v, v, voiceFrequency(v));
+            }
+
+            const double scalar_ns = nsPerSample([&] {
+                std::fill(mix.begin(), mix.end(), 0.0f);
+                renderVoices<W>(scalar, mix.data(), block_size, sample_rate);
+            }, block_size);
+
+            const double bank_ns = nsPerSample([&] {
+                std::fill(mix.begin(), mix.end(), 0.0f);
+                bank.render(mix.data(), block_size, AnalyticOscillator<W>{});
+            }, block_size);
+
+            const double table_ns = nsPerSample([&] {
+                std::fill(mix.begin(), mix.end(), 0.0f);
+                bank.render(mix.data(), block_size, wavetables.oscillator(W));
+            }, block_size);
+
+            std::printf("%-9s %6d %12.2f %12.2f %12.2f %9.2fx\n", name, voices, scalar_ns, bank_ns, table_ns, scalar_ns / bank_ns);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int block_size = argc > 1 ? std::max(1, std::atoi(argv[1])) : 64;
+
+    std::printf("simd: %s (%d lanes), block size %d, %.0f Hz\n", simd::isa_name, simd::width, block_size, sample_rate);
+    std::printf("%-9s %6s %12s %12s %12s %10s\n", "waveform", "voices", "scalar ns", "bank ns", "table ns", "speedup");
+
+    Wavetables wavetables;
+    wavetables.build(sample_rate);
+
+    benchWaveform<WaveformType::Sine>("sine", block_size, wavetables);
+    benchWaveform<WaveformType::Sawtooth>("sawtooth", block_size, wavetables);
+    benchWaveform<WaveformType::Square>("square", block_size, wavetables);
+    benchWaveform<WaveformType::Triangle>("triangle", block_size, wavetables);
+    return 0;
+}
@@ -0,0 +1,284 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <vector>
+#include "simd.h"
+#include "voice.h"
+#include "voice_slots.h"
+
+// the partials of an additive sound, lowest first: frequency ratio to the note, level, and how fast the
+// partial dies away on its own (per second, 0 to ring as long as the note is held). levels are scaled
+// so the partials together carry the power of a full-scale sine
+struct Spectrum
+{
+    const char* name = "";
+    std::vector<float> ratio;
+    std::vector<float> amplitude;
+    std::vector<float> decay;
+
+    int size() const { return static_cast<int>(ratio.size()); }
+
+    void add(float partial_ratio, float level, float decay_per_sec = 0.0f)
+    {
+        ratio.push_back(partial_ratio);
+        amplitude.push_back(level);
+        decay.push_back(decay_per_sec);
+    }
+
+    void normalize()
+    {
+        double power = 0.0;
+        for (float level : amplitude)
+            power += static_cast<double>(level) * level;
+        const auto scale = static_cast<float>(1.0 / std::sqrt(std::max(power, 1e-12)));
+        for (float& level : amplitude)
+            level *= scale;
+    }
+};
+
+// built once, on first use
+inline std::span<const Spectrum> spectrumPresets()
+{
+    static const std::vector<Spectrum> presets = [] {
+        std::vector<Spectrum> list;
+
+        // drawbars 16' 8' 5 1/3' 4' 2 2/3' 2' 1 3/5' 1 1/3' 1' pulled out 8 8 6 6 4 4 3 3 2, 3 dB a step, over
+        // a faint ladder of higher harmonics for the brightness of a tonewheel
+        Spectrum organ;
+        organ.name = "organ";
+        const float drawbars[][2] = { { 0.5f, 8 }, { 1, 8 }, { 1.5f, 6 }, { 2, 6 }, { 3, 4 }, { 4, 4 }, { 5, 3 }, { 6, 3 }, { 8, 2 } };
+        for (const auto& drawbar : drawbars)
+            organ.add(drawbar[0], std::pow(10.0f, (drawbar[1] - 8.0f) * 3.0f / 20.0f));
+        for (int k = 1; k <= 64; ++k)
+            if (std::none_of(std::begin(drawbars), std::end(drawbars), [k](const auto& drawbar) { return drawbar[0] == static_cast<float>(k); }))
+                organ.add(static_cast<float>(k), 0.02f / static_cast<float>(k));
+        list.push_back(organ);
+
+        // a church bell: hum, prime, tierce, quint and nominal, then the upper modes stretched ever
+        // sharper. higher modes ring shorter
+        Spectrum bell;
+        bell.name = "bell";
+        const float modes[][2] = { { 0.5f, 0.6f }, { 1.0f, 1.0f }, { 1.19f, 0.7f }, { 1.5f, 0.45f }, { 2.0f, 0.8f }, { 2.52f, 0.35f }, { 2.66f, 0.3f }, { 3.01f, 0.25f } };
+        for (const auto& mode : modes)
+            bell.add(mode[0], mode[1], 0.6f + mode[0] * 0.5f);
+        for (int k = 8; k < 128; ++k)
+        {
+            const float ratio = 3.0f + std::pow(static_cast<float>(k - 7), 1.15f) * 0.37f;
+            bell.add(ratio, 0.25f / static_cast<float>(k - 5), 0.6f + ratio * 0.5f);
+        }
+        list.push_back(bell);
+
+        // every harmonic at 1/k, a sawtooth with no aliasing at any pitch
+        Spectrum bright;
+        bright.name = "bright";
+        for (int k = 1; k <= 256; ++k)
+            bright.add(static_cast<float>(k), 1.0f / static_cast<float>(k));
+        list.push_back(bright);
+
+        // odd harmonics only, like a square or a clarinet
+        Spectrum hollow;
+        hollow.name = "hollow";
+        for (int k = 1; k <= 255; k += 2)
+            hollow.add(static_cast<float>(k), 1.0f / static_cast<float>(k));
+        list.push_back(hollow);
+
+        for (auto& spectrum : list)
+        {
+            // lowest first, so the partials above Nyquist are always a tail that can be cut off
+            std::vector<int> order(static_cast<std::size_t>(spectrum.size()));
+            for (std::size_t i = 0; i < order.size(); ++i)
+                order[i] = static_cast<int>(i);
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return spectrum.ratio[a] < spectrum.ratio[b]; });
+            Spectrum sorted;
+            sorted.name = spectrum.name;
+            for (int i : order)
+                sorted.add(spectrum.ratio[i], spectrum.amplitude[i], spectrum.decay[i]);
+            sorted.normalize();
+            spectrum = std::move(sorted);
+        }
+        return list;
+    }();
+    return presets;
+}
+
+// the additive voice type: every note is a sum of up to max_partials sines from a Spectrum. each partial
+// is a recursive oscillator, a complex number turned by a fixed rotation every sample (four multiplies
+// and two adds, no sin), simd::width partials at a time. the rotation also carries the partial's decay.
+// float rounding makes the magnitude wander, so every renorm_interval samples it is pulled back to where
+// the decay says it should be. partials at or above Nyquist are dropped at note-on, so the cost of a note
+// is fixed by its spectrum and pitch when it starts.
+// audio thread only
+class AdditiveBank
+{
+public:
+    static constexpr int max_partials = 256;
+    static constexpr int renorm_interval = 64;
+
+    void prepare(double new_sample_rate, int polyphony, const AdsrParams& params)
+    {
+        sample_rate = new_sample_rate;
+        slots.prepare(polyphony, sample_rate, params);
+        spectrumPresets(); // built now rather than on the first note-on
+
+        const auto lanes = static_cast<std::size_t>(slots.size()) * max_partials;
+        re.assign(lanes, 0.0f);
+        im.assign(lanes, 0.0f);
+        rot_re.assign(lanes, 0.0f);
+        rot_im.assign(lanes, 0.0f);
+        target_sq.assign(lanes, 0.0f);
+        decay_sq.assign(lanes, 1.0f);
+        voices.assign(static_cast<std::size_t>(slots.size()), Voice{});
+        sums.assign(static_cast<std::size_t>(chunk * simd::width), 0.0f);
+    }
+
+    void noteOn(int key, float frequency, const Spectrum& partials)
+    {
+        const int v = slots.noteOn(key);
+        if (v < 0)
+            return;
+
+        const double nyquist = 0.5 * sample_rate;
+        int count = 0;
+        while (count < std::min(partials.size(), max_partials) && partials.ratio[static_cast<std::size_t>(count)] * frequency < nyquist)
+            ++count;
+
+        // the rotations are worked out once per partial here; nothing per sample calls sin
+        const std::size_t base = static_cast<std::size_t>(v) * max_partials;
+        for (int k = 0; k < simd::paddedCount(count); ++k)
+        {
+            const std::size_t at = base + static_cast<std::size_t>(k);
+            if (k >= count)
+            {
+                re[at] = im[at] = rot_re[at] = rot_im[at] = target_sq[at] = 0.0f;
+                decay_sq[at] = 1.0f;
+                continue;
+            }
+            const auto i = static_cast<std::size_t>(k);
+            const double omega = two_pi_d * partials.ratio[i] * frequency / sample_rate;
+            const double rho = std::exp(-partials.decay[i] / sample_rate);
+            const double amplitude = partials.amplitude[i];
+            re[at] = static_cast<float>(amplitude); // starts at phase 0, where the sine is silent
+            im[at] = 0.0f;
+            rot_re[at] = static_cast<float>(rho * std::cos(omega));
+            rot_im[at] = static_cast<float>(rho * std::sin(omega));
+            target_sq[at] = static_cast<float>(amplitude * amplitude);
+            decay_sq[at] = static_cast<float>(std::pow(rho, 2.0 * renorm_interval));
+        }
+        voices[static_cast<std::size_t>(v)] = { simd::paddedCount(count) / simd::width, renorm_interval };
+    }
+
+    void noteOff(int key) { slots.noteOff(key); }
+
+    // adds every sounding voice into mix
+    void render(float* mix, int num_samples)
+    {
+        for (int v = 0; v < slots.size(); ++v)
+            if (slots.isSounding(v))
+                renderVoice(v, mix, num_samples);
+    }
+
+    // partials still sounding, for load estimates
+    int numPartials() const
+    {
+        int total = 0;
+        for (int v = 0; v < slots.size(); ++v)
+            if (slots.isSounding(v))
+                total += voices[static_cast<std::size_t>(v)].groups * simd::width;
+        return total;
+    }
+
+private:
+    static constexpr int chunk = 256;
+
+    struct Voice
+    {
+        int groups = 0;                         // simd::width partials each
+        int until_renorm = renorm_interval;
+    };
+
+    // chunk by chunk: every group of partials runs through the chunk in registers, adding its vector of
+    // samples into sums; each sample's vector is summed across lanes once at the end, under the envelope
+    void renderVoice(int v, float* mix, int num_samples)
+    {
+        using namespace simd;
+        Voice& voice = voices[static_cast<std::size_t>(v)];
+        const std::size_t base = static_cast<std::size_t>(v) * max_partials;
+        float gain[chunk];
+
+        for (int done = 0; done < num_samples;)
+        {
+            const int length = std::min(num_samples - done, chunk);
+            const int sounding = slots.envelopeGain(v, gain, length);
+            std::fill(sums.begin(), sums.begin() + static_cast<std::ptrdiff_t>(sounding) * width, 0.0f);
+
+            int until_renorm = voice.until_renorm;
+            for (int group = 0; group < voice.groups; ++group)
+            {
+                const std::size_t at = base + static_cast<std::size_t>(group) * width;
+                vfloat x = load(&re[at]);
+                vfloat y = load(&im[at]);
+                const vfloat c = load(&rot_re[at]);
+                const vfloat s = load(&rot_im[at]);
+                vfloat target = load(&target_sq[at]);
+                const vfloat decay = load(&decay_sq[at]);
+
+                until_renorm = voice.until_renorm;
+                for (int sample = 0; sample < sounding;)
+                {
+                    const int run = std::min(sounding - sample, until_renorm);
+                    for (int end = sample + run; sample < end; ++sample)
+                    {
+                        const vfloat turned_x = sub(mul(x, c), mul(y, s));
+                        y = add(mul(x, s), mul(y, c));
+                        x = turned_x;
+                        float* sum = &sums[static_cast<std::size_t>(sample) * width];
+                        store(sum, add(load(sum), y));
+                    }
+                    until_renorm -= run;
+                    if (until_renorm == 0)
+                    {
+                        // one Newton step towards |z|² = target: z·(3 - |z|²/target)/2, exact enough
+                        // since the drift between renormalizations is tiny
+                        target = mul(target, decay);
+                        const vfloat magnitude_sq = add(mul(x, x), mul(y, y));
+                        const vfloat ratio = div(magnitude_sq, max(target, broadcast(1e-24f)));
+                        const vfloat correction = sub(broadcast(1.5f), mul(broadcast(0.5f), ratio));
+                        x = mul(x, correction);
+                        y = mul(y, correction);
+                        until_renorm = renorm_interval;
+                    }
+                }
+
+                store(&re[at], x);
+                store(&im[at], y);
+                store(&target_sq[at], target);
+            }
+
+            voice.until_renorm = until_renorm; // every group got to the same point
+            for (int sample = 0; sample < sounding; ++sample)
+                mix[done + sample] += reduceAdd(load(&sums[static_cast<std::size_t>(sample) * width])) * gain[sample];
+
+            if (sounding < length)
+                break; // released all the way
+            done += length;
+        }
+    }
+
+    template <typename T>
+    using lane_vector = std::vector<T, simd::AlignedAllocator<T>>;
+
+    double sample_rate = 44100.0;
+    VoiceSlots slots;
+    std::vector<Voice> voices;
+    // max_partials per voice, in voice order
+    lane_vector<float> re;
+    lane_vector<float> im;
+    lane_vector<float> rot_re;
+    lane_vector<float> rot_im;
+    lane_vector<float> target_sq; // squared magnitude the partial had at its last renormalization
+    lane_vector<float> decay_sq;  // what target_sq shrinks by between renormalizations
+    lane_vector<float> sums;      // chunk vectors of simd::width partial sums
+};
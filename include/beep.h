@@ -3,13 +3,15 @@
 #include <juce_audio_utils/juce_audio_utils.h>
 #include <juce_gui_basics/juce_gui_basics.h>
 #include "notes.h"
+#include "oscillator.h"
 
 class KeyBeep : public juce::AudioAppComponent
 {
 private:
     float frequency = C4;
-    float phase     = 0.0f; // phase of the sine wave
+    uint32_t phase  = 0;    // phase of the sine wave, a full cycle is 2^32
     double rate     = 44100.0;
+    uint32_t phase_inc = phaseIncrement(frequency, rate);
     float amplitude = 0.3f; // influences volume
     int block_size  = 888;
     bool going_up   = true;
@@ -31,6 +33,9 @@ public:
 
         std::cout << "my sample rate: " << rate << std::endl;
         std::cout << "my block size: " << block_size << std::endl;
+
+        rate = newSampleRate;
+        phase_inc = phaseIncrement(frequency, rate);
     }
 
     void releaseResources() override
@@ -49,15 +54,15 @@ public:
             auto* ch_data = bufferToFill.buffer->getWritePointer(channel, bufferToFill.startSample);
             for (int sample = 0; sample < bufferToFill.numSamples; ++sample)
             {
-                ch_data[sample] = amplitude * std::sin(phase);
-                float phase_delta = static_cast<float>((juce::MathConstants<double>::twoPi * frequency / rate));
-                phase = std::fmod(phase + phase_delta, juce::MathConstants<double>::twoPi);
+                ch_data[sample] = amplitude * waveFromPhase<WaveformType::Sine>(phase);
+                phase += phase_inc; // wraps on its own
 
                 if (sample % block_size == 0)
                 {
                     going_up ? frequency += 1.0f : frequency -= 5.0f;
                     if (frequency >= E5) { going_up = false; block_size *= 2; }
                     else if (frequency <= C4) { going_up = true; block_size /= 5; }
+                    phase_inc = phaseIncrement(frequency, rate);
                 }
             }
         }
@@ -0,0 +1,94 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+
+struct AdsrParams
+{
+    float attack_secs   = 0.005f;
+    float decay_secs    = 0.15f;
+    float sustain_level = 0.8f;
+    float release_secs  = 0.25f; // from full level down to silence
+};
+
+enum class EnvelopeStage : uint8_t
+{
+    Idle,
+    Attack,
+    Decay,
+    Sustain,
+    Release
+};
+
+// one exponential segment: every sample level = level·coef + offset, which curves towards a target
+// set a little past the goal so the goal is reached in a finite, exactly known number of samples.
+// small ratios give a steep exponential, large ones something close to a straight line
+struct EnvelopeSegment
+{
+    static constexpr int endless = INT_MAX; // sustain and idle never end on their own
+
+    float coef     = 1.0f;
+    float offset   = 0.0f;
+    double target  = 0.0;
+    double goal    = 0.0;
+    double log_coef = 0.0;
+
+    // the curve that goes from `from` to `goal` in `samples`
+    static EnvelopeSegment make(double from, double goal, double samples, double ratio)
+    {
+        EnvelopeSegment segment;
+        const double c = std::pow(ratio / (1.0 + ratio), 1.0 / std::max(samples, 1.0));
+        segment.goal = goal;
+        segment.target = goal + (goal - from) * ratio;
+        segment.coef = static_cast<float>(c);
+        segment.offset = static_cast<float>(segment.target * (1.0 - c));
+        segment.log_coef = std::log(c);
+        return segment;
+    }
+
+    // holds level where it is
+    static EnvelopeSegment hold(double level)
+    {
+        EnvelopeSegment segment;
+        segment.goal = segment.target = level;
+        return segment;
+    }
+
+    // samples until the curve reaches the goal when it starts at level; 0 if it is there already.
+    // lets a segment start anywhere, e.g. a release from the middle of the attack
+    int samplesFrom(float level) const
+    {
+        const double remaining = (goal - target) / (level - target);
+        if (!(remaining > 0.0 && remaining < 1.0))
+            return 0;
+        return static_cast<int>(std::min(std::ceil(std::log(remaining) / log_coef), static_cast<double>(endless - 1)));
+    }
+};
+
+// the segments of the current ADSR settings at the current sample rate. recomputed only when one
+// of them changes; voices take their per-sample coefficients from here when they enter a stage
+struct AdsrCoefficients
+{
+    static constexpr double attack_ratio  = 0.3;   // nearly linear, so the onset doesn't click
+    static constexpr double decay_ratio   = 0.001; // exponential, like a string or a bell
+    static constexpr double fade_out_secs = 0.002; // stolen voices
+
+    EnvelopeSegment attack;
+    EnvelopeSegment decay;
+    EnvelopeSegment sustain;
+    EnvelopeSegment release;
+    EnvelopeSegment fade_out;
+    EnvelopeSegment idle = EnvelopeSegment::hold(0.0);
+
+    void compute(const AdsrParams& params, double sample_rate)
+    {
+        const double sustain_level = std::clamp(static_cast<double>(params.sustain_level), 0.0, 1.0);
+        attack   = EnvelopeSegment::make(0.0, 1.0, params.attack_secs * sample_rate, attack_ratio);
+        decay    = EnvelopeSegment::make(1.0, sustain_level, params.decay_secs * sample_rate, decay_ratio);
+        sustain  = EnvelopeSegment::hold(sustain_level);
+        release  = EnvelopeSegment::make(1.0, 0.0, params.release_secs * sample_rate, decay_ratio);
+        fade_out = EnvelopeSegment::make(1.0, 0.0, fade_out_secs * sample_rate, attack_ratio);
+        idle.coef = 0.0f;
+    }
+};
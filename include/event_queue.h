@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// wait-free single-producer/single-consumer ring. one thread pushes, one thread pops, neither ever blocks
+// or allocates; a full ring just refuses the push. Capacity must be a power of two
+template <typename T, std::size_t Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    // producer side
+    bool push(const T& item)
+    {
+        const auto tail = write_index.load(std::memory_order_relaxed);
+        if (tail - read_index.load(std::memory_order_acquire) == Capacity)
+            return false;
+
+        items[tail & (Capacity - 1)] = item;
+        write_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // either side. from the producer: true once the consumer has popped everything pushed so far
+    bool empty() const
+    {
+        return read_index.load(std::memory_order_acquire) == write_index.load(std::memory_order_acquire);
+    }
+
+    // consumer side: the oldest item, or nullptr when empty. stays valid until pop()
+    const T* peek() const
+    {
+        const auto head = read_index.load(std::memory_order_relaxed);
+        if (head == write_index.load(std::memory_order_acquire))
+            return nullptr;
+        return &items[head & (Capacity - 1)];
+    }
+
+    bool pop(T& item)
+    {
+        const T* front = peek();
+        if (front == nullptr)
+            return false;
+
+        item = *front;
+        read_index.store(read_index.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return true;
+    }
+
+    void pop()
+    {
+        read_index.store(read_index.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::array<T, Capacity> items{};
+    // producer and consumer indices on separate cache lines so they don't bounce between cores
+    alignas(64) std::atomic<std::size_t> write_index{ 0 };
+    alignas(64) std::atomic<std::size_t> read_index{ 0 };
+};
+
+// monotonic timestamp for events crossing from the message thread to the audio thread
+inline int64_t nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct NoteEvent
+{
+    enum class Type : uint8_t
+    {
+        NoteOn,
+        NoteOff
+    };
+
+    Type type       = Type::NoteOn;
+    int key_code    = -1;
+    float frequency = 0.0f;  // resolved by the sender, the audio thread never looks keys up
+    int64_t time_ns = 0;     // nowNanos() when the key went down/up
+    int priority    = 0;     // higher keeps its voice longer under StealPolicy::LowestPriority
+};
+
+// places wall-clock event times at sample offsets inside the block that is being rendered.
+// everything is delayed by exactly one block, which keeps the spacing between events intact
+// instead of quantising every onset to a block boundary
+class BlockClock
+{
+public:
+    void reset(double new_sample_rate)
+    {
+        sample_rate = new_sample_rate;
+        previous_block_ns = nowNanos();
+    }
+
+    // call at the top of the callback; returns the time events must not be newer than
+    int64_t beginBlock()
+    {
+        block_start_ns = previous_block_ns;
+        previous_block_ns = nowNanos();
+        return previous_block_ns;
+    }
+
+    int offsetFor(int64_t time_ns, int num_samples) const
+    {
+        const double seconds = static_cast<double>(time_ns - block_start_ns) * 1e-9;
+        const auto offset = static_cast<int64_t>(seconds * sample_rate);
+        return static_cast<int>(std::clamp<int64_t>(offset, 0, num_samples - 1));
+    }
+
+private:
+    double sample_rate = 44100.0;
+    int64_t previous_block_ns = 0;
+    int64_t block_start_ns = 0;
+};
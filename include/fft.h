@@ -0,0 +1,110 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "voice.h"
+
+// inverse FFT of a real signal: bins 0..size/2 of its spectrum in, size samples out, unnormalized
+// (x[n] = Σ X[k]·e^(2πikn/size) over all size bins, the upper half being the mirror of the lower).
+// done as one complex transform of half the size, with the even samples in the real part and the odd
+// ones in the imaginary part. tables are built by prepare(); transform() doesn't allocate.
+// size is a power of two, at least 4
+class InverseRealFft
+{
+public:
+    void prepare(int new_size)
+    {
+        size = new_size;
+        half = size / 2;
+
+        bit_reversed.resize(static_cast<std::size_t>(half));
+        int bits = 0;
+        while ((1 << bits) < half)
+            ++bits;
+        for (int i = 0; i < half; ++i)
+        {
+            int reversed = 0;
+            for (int b = 0; b < bits; ++b)
+                reversed |= ((i >> b) & 1) << (bits - 1 - b);
+            bit_reversed[static_cast<std::size_t>(i)] = reversed;
+        }
+
+        // e^(2πik/half) for the butterflies, e^(2πik/size) for untangling the halves
+        twiddle_re.resize(static_cast<std::size_t>(half / 2));
+        twiddle_im.resize(static_cast<std::size_t>(half / 2));
+        for (int k = 0; k < half / 2; ++k)
+        {
+            twiddle_re[static_cast<std::size_t>(k)] = static_cast<float>(std::cos(two_pi_d * k / half));
+            twiddle_im[static_cast<std::size_t>(k)] = static_cast<float>(std::sin(two_pi_d * k / half));
+        }
+        split_re.resize(static_cast<std::size_t>(half));
+        split_im.resize(static_cast<std::size_t>(half));
+        for (int k = 0; k < half; ++k)
+        {
+            split_re[static_cast<std::size_t>(k)] = static_cast<float>(std::cos(two_pi_d * k / size));
+            split_im[static_cast<std::size_t>(k)] = static_cast<float>(std::sin(two_pi_d * k / size));
+        }
+        z_re.assign(static_cast<std::size_t>(half), 0.0f);
+        z_im.assign(static_cast<std::size_t>(half), 0.0f);
+    }
+
+    int frameSize() const { return size; }
+
+    // re and im hold size/2 + 1 bins; the imaginary parts of bin 0 and size/2 are ignored
+    void transform(const float* re, const float* im, float* out)
+    {
+        // with X[k + half] = conj(X[half - k]): even samples come from X[k] + X[k + half], odd ones from
+        // (X[k] - X[k + half])·e^(2πik/size). both go into one bin, the odd ones turned by i
+        for (int k = 0; k < half; ++k)
+        {
+            const float lower_im = k == 0 ? 0.0f : im[k];
+            const float upper_re = re[half - k];
+            const float upper_im = k == 0 ? 0.0f : -im[half - k];
+            const float even_re = re[k] + upper_re;
+            const float even_im = lower_im + upper_im;
+            const float diff_re = re[k] - upper_re;
+            const float diff_im = lower_im - upper_im;
+            const float odd_re = diff_re * split_re[static_cast<std::size_t>(k)] - diff_im * split_im[static_cast<std::size_t>(k)];
+            const float odd_im = diff_re * split_im[static_cast<std::size_t>(k)] + diff_im * split_re[static_cast<std::size_t>(k)];
+            const auto at = static_cast<std::size_t>(bit_reversed[static_cast<std::size_t>(k)]);
+            z_re[at] = even_re - odd_im;
+            z_im[at] = even_im + odd_re;
+        }
+
+        for (int length = 2; length <= half; length <<= 1)
+        {
+            const int stride = half / length;
+            for (int start = 0; start < half; start += length)
+                for (int k = 0; k < length / 2; ++k)
+                {
+                    const auto a = static_cast<std::size_t>(start + k);
+                    const auto b = a + static_cast<std::size_t>(length / 2);
+                    const float w_re = twiddle_re[static_cast<std::size_t>(k * stride)];
+                    const float w_im = twiddle_im[static_cast<std::size_t>(k * stride)];
+                    const float v_re = z_re[b] * w_re - z_im[b] * w_im;
+                    const float v_im = z_re[b] * w_im + z_im[b] * w_re;
+                    z_re[b] = z_re[a] - v_re;
+                    z_im[b] = z_im[a] - v_im;
+                    z_re[a] += v_re;
+                    z_im[a] += v_im;
+                }
+        }
+
+        for (int n = 0; n < half; ++n)
+        {
+            out[2 * n] = z_re[static_cast<std::size_t>(n)];
+            out[2 * n + 1] = z_im[static_cast<std::size_t>(n)];
+        }
+    }
+
+private:
+    int size = 0;
+    int half = 0;
+    std::vector<int> bit_reversed;
+    std::vector<float> twiddle_re;
+    std::vector<float> twiddle_im;
+    std::vector<float> split_re;
+    std::vector<float> split_im;
+    std::vector<float> z_re;
+    std::vector<float> z_im;
+};
@@ -0,0 +1,129 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// what the last callbacks cost, as a fraction of the time the device gave them (1.0 = the whole
+// block period)
+struct LoadStats
+{
+    float current = 0.0f; // the most recent callback
+    float p99 = 0.0f;     // to the histogram's 1% resolution
+    float max = 0.0f;
+    uint64_t callbacks = 0;
+    uint64_t overruns = 0; // callbacks that took longer than their block lasts
+    uint64_t xruns = 0;    // callbacks that started late enough that the device has probably run dry
+};
+
+// timestamps every audio callback and keeps its load in a histogram. only the audio thread writes,
+// with plain relaxed stores, so recording costs two clock reads and a handful of stores; any other
+// thread can read the stats at any time without locking anything or holding the audio thread up.
+// a stats() call racing a callback may see that callback half counted, which is fine for a meter
+//
+// xruns are an estimate: the device asks for a block when it has played the previous one, so a
+// callback that starts more than half a period after the previous one should have finished is one
+// the device most likely had to fill with silence
+class LoadMonitor
+{
+public:
+    static constexpr int num_buckets = 200; // 1% each; the last one also holds everything above 199%
+
+    // audio thread
+    void beginCallback(int64_t now_ns)
+    {
+        if (reset_requested.exchange(false, std::memory_order_acquire))
+            clear();
+
+        if (previous_start_ns != 0 && now_ns - previous_start_ns > previous_period_ns + previous_period_ns / 2)
+            bump(xruns);
+        callback_start_ns = now_ns;
+    }
+
+    void endCallback(int64_t now_ns, int num_samples, double sample_rate)
+    {
+        const auto period_ns = static_cast<int64_t>(num_samples * 1e9 / sample_rate);
+        previous_start_ns = callback_start_ns;
+        previous_period_ns = period_ns;
+        if (period_ns <= 0)
+            return;
+
+        const float load = static_cast<float>(now_ns - callback_start_ns) / static_cast<float>(period_ns);
+        current.store(load, std::memory_order_relaxed);
+        if (load > max.load(std::memory_order_relaxed))
+            max.store(load, std::memory_order_relaxed);
+        if (load > 1.0f)
+            bump(overruns);
+
+        const int bucket = load < static_cast<float>(num_buckets) / 100.0f ? static_cast<int>(load * 100.0f) : num_buckets - 1;
+        bump(buckets[static_cast<std::size_t>(bucket)]);
+        bump(callbacks);
+    }
+
+    // any thread: forget everything recorded so far, from the next callback on
+    void reset() { reset_requested.store(true, std::memory_order_release); }
+
+    // any thread
+    LoadStats stats() const
+    {
+        LoadStats stats;
+        stats.current = current.load(std::memory_order_relaxed);
+        stats.max = max.load(std::memory_order_relaxed);
+        stats.callbacks = callbacks.load(std::memory_order_relaxed);
+        stats.overruns = overruns.load(std::memory_order_relaxed);
+        stats.xruns = xruns.load(std::memory_order_relaxed);
+
+        std::array<uint64_t, num_buckets> counts;
+        uint64_t total = 0;
+        for (int i = 0; i < num_buckets; ++i)
+        {
+            counts[static_cast<std::size_t>(i)] = buckets[static_cast<std::size_t>(i)].load(std::memory_order_relaxed);
+            total += counts[static_cast<std::size_t>(i)];
+        }
+
+        // smallest bucket with at least 99% of the callbacks at or below it; its upper edge is reported
+        const uint64_t wanted = total - total / 100;
+        uint64_t seen = 0;
+        for (int i = 0; i < num_buckets && total > 0; ++i)
+        {
+            seen += counts[static_cast<std::size_t>(i)];
+            if (seen >= wanted)
+            {
+                stats.p99 = static_cast<float>(i + 1) / 100.0f;
+                break;
+            }
+        }
+        return stats;
+    }
+
+private:
+    // single writer, so a load and a store is enough and avoids a locked instruction per count
+    static void bump(std::atomic<uint64_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void clear()
+    {
+        for (auto& bucket : buckets)
+            bucket.store(0, std::memory_order_relaxed);
+        current.store(0.0f, std::memory_order_relaxed);
+        max.store(0.0f, std::memory_order_relaxed);
+        callbacks.store(0, std::memory_order_relaxed);
+        overruns.store(0, std::memory_order_relaxed);
+        xruns.store(0, std::memory_order_relaxed);
+        previous_start_ns = 0;
+    }
+
+    std::array<std::atomic<uint64_t>, num_buckets> buckets{};
+    std::atomic<float> current{ 0.0f };
+    std::atomic<float> max{ 0.0f };
+    std::atomic<uint64_t> callbacks{ 0 };
+    std::atomic<uint64_t> overruns{ 0 };
+    std::atomic<uint64_t> xruns{ 0 };
+    std::atomic<bool> reset_requested{ false };
+
+    // audio thread only
+    int64_t callback_start_ns = 0;
+    int64_t previous_start_ns = 0;
+    int64_t previous_period_ns = 0;
+};
@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// a whole file mapped read-only into memory. opening costs the same for 1 KB or 1 GB: pages are only
+// read from disk when something touches them, and the OS can drop them again under memory pressure.
+// touching a page that isn't resident blocks on the disk, so audio threads should only read mapped
+// data that something else has already touched
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // sequential: hint that the file will be read front to back, so the OS reads ahead
+    bool open(const std::string& path, bool sequential = false)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER file_size{};
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+        {
+            close();
+            return false;
+        }
+        bytes = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        length = static_cast<std::size_t>(file_size.QuadPart);
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info{};
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void* memory = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps the file open
+        if (memory == MAP_FAILED)
+            return false;
+        if (sequential)
+            madvise(memory, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+        bytes = static_cast<const uint8_t*>(memory);
+        length = static_cast<std::size_t>(info.st_size);
+#endif
+        if (bytes == nullptr)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (bytes != nullptr)
+            UnmapViewOfFile(bytes);
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes != nullptr)
+            munmap(const_cast<uint8_t*>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    // residency hints for a reader streaming through the file: start reading [offset, offset + count)
+    // in from disk now, or let go of the whole pages inside it (touching them again reads them back).
+    // only hints; the OS is left to manage residency on Windows
+    void willNeed(std::size_t offset, std::size_t count) const
+    {
+#ifndef _WIN32
+        const std::size_t begin = offset / pageSize() * pageSize();
+        const std::size_t end = std::min(offset + count, length);
+        if (bytes != nullptr && begin < end)
+            madvise(const_cast<uint8_t*>(bytes) + begin, end - begin, MADV_WILLNEED);
+#else
+        (void)offset;
+        (void)count;
+#endif
+    }
+
+    void dontNeed(std::size_t offset, std::size_t count) const
+    {
+#ifndef _WIN32
+        const std::size_t begin = (offset + pageSize() - 1) / pageSize() * pageSize();
+        const std::size_t end = std::min(offset + count, length) / pageSize() * pageSize();
+        if (bytes != nullptr && begin < end)
+            madvise(const_cast<uint8_t*>(bytes) + begin, end - begin, MADV_DONTNEED);
+#else
+        (void)offset;
+        (void)count;
+#endif
+    }
+
+    bool isOpen() const          { return bytes != nullptr; }
+    const uint8_t* data() const  { return bytes; }
+    std::size_t size() const     { return length; }
+
+private:
+#ifndef _WIN32
+    static std::size_t pageSize()
+    {
+        static const auto size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        return size;
+    }
+#endif
+
+    const uint8_t* bytes = nullptr;
+    std::size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
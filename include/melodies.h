@@ -0,0 +1,54 @@
+#pragma once
+#include <array>
+#include <map>
+#include <span>
+#include "notes.h"
+#include "voice.h"
+
+// what the app can play, shared with the offline tools: the computer keyboard layout (E3 to E5 laid out
+// like a piano) and the built-in melodies
+inline std::map<int, Note> keyboardNoteMap()
+{
+    return {
+        // piano
+        {'A', {E3}}, {'W', {F3}}, {'S', {G3b}}, {'E', {G3}},
+        {'D', {A3b}}, {'F', {A3}}, {'T', {B3b}}, {'G', {B3}},
+        {'Y', {C4}}, {'H', {D4b}}, {'U', {D4}}, {'J', {E4b}},
+        {'K', {E4}}, {'O', {F4}}, {'L', {G4b}}, {'P', {G4}},
+        {';', {A4b}}, {'Z', {A4}}, {'X', {B4b}}, {'C', {B4}},
+        {'V', {C5}}, {'B', {D5b}}, {'N', {D5}}, {'M', {E5b}},
+        {'.', {E5}}, {'Z', {F5}}
+    };
+}
+
+// a melody as written, plus how it should be played. tempo and transposition are not baked into
+// the notes; the sequencer applies them as it plays (SequencerCommand::Play)
+struct MelodyEntry
+{
+    const char* name;
+    std::span<const MelodyNote> notes;
+    double tempo = 1.0;  // playback speed, 2.0 plays twice as fast
+    int transpose = 0;   // semitones
+};
+
+inline constexpr std::array<MelodyEntry, 13> melody_catalog = { {
+    { "melody_ddlc", melody_ddlc, 1.5 }, // DDLC theme is played at 1.5x speed
+    { "melody1", melody1 },
+    { "melody2", melody2 },
+    { "melody_cinematic", melody_cinematic },
+    { "melody_edm", melody_edm },
+    { "melody_jazz", melody_jazz },
+    { "melody_ambient", melody_ambient },
+    { "melody_funk", melody_funk },
+    { "melody_classical", melody_classical },
+    { "melody_minimalist", melody_minimalist },
+    { "melody_epic", melody_epic },
+    { "melody_odyssey", melody_odyssey },
+    { "melody_symphony", melody_symphony },
+} };
+
+// every built-in melody, in the order of the app's dropdown
+inline std::span<const MelodyEntry> melodyCatalog()
+{
+    return melody_catalog;
+}
@@ -0,0 +1,329 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mapped_file.h"
+#include "sequencer.h"
+
+// MIDI notes get key codes of their own, above the computer keyboard's ASCII ones, so a file playing
+// along with someone at the keyboard never releases their keys
+constexpr int midi_key_base = 128;
+
+inline float midiNoteFrequency(int note)
+{
+    return static_cast<float>(440.0 * std::exp2((note - 69) / 12.0));
+}
+
+// a Standard MIDI File (format 0 or 1), memory-mapped. open() only reads the header and finds where
+// each track chunk starts and ends; the events stay undecoded in the mapping until a MidiEventReader
+// walks them
+class MidiFile
+{
+public:
+    struct Track
+    {
+        const uint8_t* begin = nullptr;
+        const uint8_t* end = nullptr;
+    };
+
+    bool open(const std::string& path)
+    {
+        tracks.clear();
+        if (!file.open(path, true))
+            return fail("can't open " + path);
+
+        const uint8_t* data = file.data();
+        const std::size_t size = file.size();
+        if (size < 14 || !hasTag(data, "MThd") || read32(data + 4) < 6)
+            return fail(path + " is not a MIDI file");
+
+        format = read16(data + 8);
+        const int num_tracks = read16(data + 10);
+        division = read16(data + 12);
+        if (format > 1)
+            return fail(path + " is format " + std::to_string(format) + ", only 0 and 1 are supported");
+        if (division == 0)
+            return fail(path + " has no time division");
+        if (division & 0x8000)
+        {
+            // SMPTE: negative frames per second in the high byte, ticks per frame in the low one
+            const int frames_per_sec = -static_cast<int8_t>(division >> 8);
+            const bool standard_rate = frames_per_sec == 24 || frames_per_sec == 25 || frames_per_sec == 29 || frames_per_sec == 30;
+            if (!standard_rate || (division & 0xFF) == 0)
+                return fail(path + " has an invalid SMPTE time division");
+        }
+
+        std::size_t at = 8 + read32(data + 4);
+        while (at + 8 <= size && static_cast<int>(tracks.size()) < num_tracks)
+        {
+            const std::size_t length = read32(data + at + 4);
+            const std::size_t body = at + 8;
+            if (hasTag(data + at, "MTrk"))
+                tracks.push_back({ data + body, data + std::min(body + length, size) }); // tolerate a truncated last track
+            at = body + length;
+        }
+        if (tracks.empty())
+            return fail(path + " has no tracks");
+        return true;
+    }
+
+    const std::vector<Track>& trackList() const { return tracks; }
+    int formatType() const                      { return format; }
+    // ticks per quarter note, or with the top bit set, SMPTE frames per second and ticks per frame
+    int timeDivision() const                    { return division; }
+    const std::string& error() const            { return error_text; }
+
+private:
+    static bool hasTag(const uint8_t* data, const char* tag)
+    {
+        return data[0] == tag[0] && data[1] == tag[1] && data[2] == tag[2] && data[3] == tag[3];
+    }
+
+    static int read16(const uint8_t* data)            { return data[0] << 8 | data[1]; }
+    static std::size_t read32(const uint8_t* data)
+    {
+        return static_cast<std::size_t>(data[0]) << 24 | static_cast<std::size_t>(data[1]) << 16 | static_cast<std::size_t>(data[2]) << 8 | data[3];
+    }
+
+    bool fail(std::string text)
+    {
+        error_text = std::move(text);
+        tracks.clear();
+        file.close();
+        return false;
+    }
+
+    MappedFile file;
+    std::vector<Track> tracks;
+    int format = 0;
+    int division = 0;
+    std::string error_text;
+};
+
+// decodes a MidiFile's tracks one event at a time, merged into time order, as note-on/off ScoreEvents
+// in seconds. the tempo map is applied as the tempo events go by, so nothing is read ahead of what's
+// asked for and nothing is allocated per event. the file must outlive the reader
+class MidiEventReader
+{
+public:
+    explicit MidiEventReader(const MidiFile& midi)
+    {
+        const int division = midi.timeDivision();
+        if (division & 0x8000)
+        {
+            const int frames_per_sec = -static_cast<int8_t>(division >> 8);
+            secs_per_tick = 1.0 / (frames_per_sec * (division & 0xFF)); // both checked non-zero by MidiFile::open()
+            ticks_per_quarter = 0; // SMPTE time ignores tempo events
+        }
+        else
+        {
+            ticks_per_quarter = division;
+            secs_per_tick = default_tempo_us / 1e6 / ticks_per_quarter;
+        }
+
+        cursors.reserve(midi.trackList().size());
+        for (const auto& track : midi.trackList())
+        {
+            cursors.push_back({ track.begin, track.end });
+            readDelta(cursors.back());
+        }
+    }
+
+    // the next note event in time order; false once every track has ended
+    bool next(ScoreEvent& event)
+    {
+        for (;;)
+        {
+            // tracks are few, a linear scan beats a heap. ties go to the lower track, so a tempo change in
+            // track 0 applies to notes in other tracks at the same tick
+            Cursor* earliest = nullptr;
+            for (auto& cursor : cursors)
+                if (!cursor.ended && (earliest == nullptr || cursor.tick < earliest->tick))
+                    earliest = &cursor;
+            if (earliest == nullptr)
+                return false;
+
+            const bool is_note = decode(*earliest, event);
+            readDelta(*earliest);
+            if (is_note)
+                return true;
+        }
+    }
+
+private:
+    struct Cursor
+    {
+        const uint8_t* at = nullptr;
+        const uint8_t* end = nullptr;
+        uint64_t tick = 0;
+        uint8_t running_status = 0;
+        bool ended = false;
+    };
+
+    static constexpr double default_tempo_us = 500000.0; // 120 bpm
+
+    static bool endTrack(Cursor& cursor)
+    {
+        cursor.ended = true;
+        return false;
+    }
+
+    static bool readVarLen(Cursor& cursor, uint32_t& value)
+    {
+        value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (cursor.at >= cursor.end)
+                return false;
+            const uint8_t byte = *cursor.at++;
+            value = value << 7 | (byte & 0x7F);
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    static void readDelta(Cursor& cursor)
+    {
+        uint32_t delta = 0;
+        if (cursor.ended || !readVarLen(cursor, delta))
+            cursor.ended = true;
+        else
+            cursor.tick += delta;
+    }
+
+    double secondsAt(uint64_t tick) const
+    {
+        return tempo_secs + static_cast<double>(tick - tempo_tick) * secs_per_tick;
+    }
+
+    // one event at the cursor; true and event filled in if it was a note-on or note-off
+    bool decode(Cursor& cursor, ScoreEvent& event)
+    {
+        if (cursor.at >= cursor.end)
+            return endTrack(cursor);
+
+        uint8_t status = *cursor.at;
+        if (status & 0x80)
+            ++cursor.at;
+        else
+            status = cursor.running_status; // running status: the data bytes follow directly
+        if (status < 0x80)
+            return endTrack(cursor); // data with nothing to run on: the track is corrupt
+
+        if (status == 0xFF || status == 0xF0 || status == 0xF7)
+        {
+            cursor.running_status = 0;
+            uint8_t meta_type = 0;
+            if (status == 0xFF)
+            {
+                if (cursor.at >= cursor.end)
+                    return endTrack(cursor);
+                meta_type = *cursor.at++;
+            }
+            uint32_t length = 0;
+            if (!readVarLen(cursor, length) || length > static_cast<std::size_t>(cursor.end - cursor.at))
+                return endTrack(cursor);
+            const uint8_t* data = cursor.at;
+            cursor.at += length;
+
+            if (status == 0xFF && meta_type == 0x2F)
+                cursor.ended = true;
+            else if (status == 0xFF && meta_type == 0x51 && length == 3 && ticks_per_quarter > 0)
+            {
+                const uint32_t tempo_us = data[0] << 16 | data[1] << 8 | data[2];
+                tempo_secs = secondsAt(cursor.tick);
+                tempo_tick = cursor.tick;
+                secs_per_tick = tempo_us / 1e6 / ticks_per_quarter;
+            }
+            return false;
+        }
+
+        cursor.running_status = status;
+        const int type = status & 0xF0;
+        const int data_bytes = type == 0xC0 || type == 0xD0 ? 1 : 2;
+        if (cursor.end - cursor.at < data_bytes)
+            return endTrack(cursor);
+        const uint8_t note = cursor.at[0];
+        const uint8_t velocity = data_bytes == 2 ? cursor.at[1] : 0;
+        cursor.at += data_bytes;
+
+        if (type != 0x80 && type != 0x90)
+            return false;
+        event.time_secs = secondsAt(cursor.tick);
+        event.key_code = midi_key_base + (note & 0x7F);
+        event.frequency = midiNoteFrequency(note & 0x7F);
+        event.is_on = type == 0x90 && velocity > 0; // a note-on with velocity 0 is a note-off
+        return true;
+    }
+
+    std::vector<Cursor> cursors;
+    int ticks_per_quarter = 0;
+    double secs_per_tick = 0.0;
+    // where the current tempo took over
+    uint64_t tempo_tick = 0;
+    double tempo_secs = 0.0;
+};
+
+// plays a MIDI file without ever decoding all of it: a loader thread runs a MidiEventReader a few
+// thousand events ahead of the sequencer and hands them over through a ScoreStream. only the loader
+// touches the mapping, so the audio thread never waits on a page coming in from disk, and a
+// multi-megabyte file starts as soon as its first events are decoded.
+// play it with SequencerCommand::PlayStream and keep it alive until the engine stops playing it.
+// a stream plays once; open another MidiStream on the same file to play it again
+class MidiStream
+{
+public:
+    ~MidiStream() { close(); }
+
+    bool open(const std::string& path)
+    {
+        if (loader.joinable() || !midi.open(path))
+            return false;
+        loader = std::thread([this] { load(); });
+        return true;
+    }
+
+    void close()
+    {
+        stopping.store(true, std::memory_order_relaxed);
+        if (loader.joinable())
+            loader.join();
+    }
+
+    ScoreStream* scoreStream()              { return &stream; }
+    const std::string& error() const        { return midi.error(); }
+    // note-ons decoded so far, all of them once the stream is complete
+    std::size_t numNotesDecoded() const     { return decoded_notes.load(std::memory_order_relaxed); }
+
+private:
+    void load()
+    {
+        MidiEventReader reader(midi);
+        ScoreEvent event;
+        while (reader.next(event))
+        {
+            if (event.is_on)
+                decoded_notes.fetch_add(1, std::memory_order_relaxed);
+            while (!stream.events.push(event))
+            {
+                // far enough ahead, wait for the sequencer to catch up
+                if (stopping.load(std::memory_order_relaxed))
+                    return;
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+            stream.pushed_secs.store(event.time_secs, std::memory_order_release);
+        }
+        stream.complete.store(true, std::memory_order_release);
+    }
+
+    MidiFile midi;
+    ScoreStream stream;
+    std::thread loader;
+    std::atomic<bool> stopping{ false };
+    std::atomic<std::size_t> decoded_notes{ 0 };
+};
@@ -54,7 +54,10 @@ struct MelodyNote
     double durationSecs;
 };
 
-std::vector<MelodyNote> melody_ddlc = {
+// the built-in melodies are constant tables in read-only data: nothing to construct at startup.
+// melodies.h lists them
+
+inline constexpr MelodyNote melody_ddlc[] = {
     // 5|--c---------c-----------c-|
     // 4|------g--a--------g--a----|
     {'K', 0.33, 0.3},
@@ -380,7 +383,7 @@ std::vector<MelodyNote> melody_ddlc = {
     {'D', 244.33, 0.3},
     {'G', 247.33, 0.3}};
 
-std::vector<MelodyNote> melody1 = {
+inline constexpr MelodyNote melody1[] = {
     // Opening arpeggio cascade
     {'K', 0.0, 0.2},
     {'H', 0.15, 0.2},
@@ -492,7 +495,7 @@ std::vector<MelodyNote> melody1 = {
     {'A', 25.8, 0.8},
     {'G', 26.0, 0.6}};
 
-std::vector<MelodyNote> melody2 = {
+inline constexpr MelodyNote melody2[] = {
     // Ambient intro - floating notes
     {'C', 0.0, 0.8},
     {'B', 0.5, 0.8},
@@ -701,7 +704,7 @@ std::vector<MelodyNote> melody2 = {
     {'C', 47.0, 2.0},
     {'B', 47.0, 2.0}};
 
-std::vector<MelodyNote> melody_cinematic = {
+inline constexpr MelodyNote melody_cinematic[] = {
     // --- Intro (0s - 8s): Slow, atmospheric ---
     {'M', 0.0, 4.0}, // Low bass drone
     {'L', 1.5, 1.0},
@@ -783,7 +786,7 @@ std::vector<MelodyNote> melody_cinematic = {
 };
 
 // Energetic electronic dance melody
-std::vector<MelodyNote> melody_edm = {
+inline constexpr MelodyNote melody_edm[] = {
     // Build-up (0-8s)
     {'M', 0.0, 0.25},
     {'M', 0.5, 0.25},
@@ -828,7 +831,7 @@ std::vector<MelodyNote> melody_edm = {
     {'B', 22.0, 1.0}};
 
 // Jazzy swing melody
-std::vector<MelodyNote> melody_jazz = {
+inline constexpr MelodyNote melody_jazz[] = {
     // Walking bass line
     {'M', 0.0, 0.5},
     {'.', 0.5, 0.5},
@@ -868,7 +871,7 @@ std::vector<MelodyNote> melody_jazz = {
     {'A', 11.0, 0.8}};
 
 // Mysterious ambient piece
-std::vector<MelodyNote> melody_ambient = {
+inline constexpr MelodyNote melody_ambient[] = {
     // Slow, ethereal pads
     {'M', 0.0, 8.0},
     {'A', 0.0, 8.0}, // Deep drone
@@ -893,7 +896,7 @@ std::vector<MelodyNote> melody_ambient = {
     {'C', 24.0, 4.0}};
 
 // Funky groove
-std::vector<MelodyNote> melody_funk = {
+inline constexpr MelodyNote melody_funk[] = {
     // Syncopated bass line
     {'M', 0.0, 0.2},
     {'M', 0.4, 0.1},
@@ -934,7 +937,7 @@ std::vector<MelodyNote> melody_funk = {
     {',', 8.2, 0.3}};
 
 // Classical-inspired arpeggios
-std::vector<MelodyNote> melody_classical = {
+inline constexpr MelodyNote melody_classical[] = {
     // Ascending arpeggios
     {'A', 0.0, 0.3},
     {'D', 0.25, 0.3},
@@ -975,7 +978,7 @@ std::vector<MelodyNote> melody_classical = {
     {'M', 9.0, 2.0}};
 
 // Minimalist repetitive pattern
-std::vector<MelodyNote> melody_minimalist = {
+inline constexpr MelodyNote melody_minimalist[] = {
     // Simple repeating cell
     {'G', 0.0, 0.5},
     {'H', 0.5, 0.5},
@@ -1016,7 +1019,7 @@ std::vector<MelodyNote> melody_minimalist = {
     {'L', 11.75, 0.25}};
 
 // Dramatic movie trailer style
-std::vector<MelodyNote> melody_epic = {
+inline constexpr MelodyNote melody_epic[] = {
     // Quiet beginning
     {'M', 0.0, 2.0},
     {'A', 1.0, 1.0},
@@ -1058,7 +1061,7 @@ std::vector<MelodyNote> melody_epic = {
     {'G', 15.0, 3.0},
     {'M', 15.0, 3.0}};
 
-std::vector<MelodyNote> melody_odyssey = {
+inline constexpr MelodyNote melody_odyssey[] = {
     // === MOVEMENT I: Dawn (0-30s) - Awakening ===
     // Gentle, sparse beginning - like sunrise
     {'M', 0.0, 8.0},                    // Deep bass drone
@@ -1276,7 +1279,7 @@ std::vector<MelodyNote> melody_odyssey = {
 };
 
 
-std::vector<MelodyNote> melody_symphony = {
+inline constexpr MelodyNote melody_symphony[] = {
     // === I. AWAKENING (0-45s) - The world stirs to life ===
     
     // Primordial silence broken by the first sound
@@ -0,0 +1,103 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include "simd.h"
+#include "voice.h"
+
+// how a voice turns its phase into a waveform, switchable per engine
+enum class OscillatorMode
+{
+    Analytic,  // the naive formulas below, cheapest but alias above ~C5
+    Wavetable, // band-limited mipmapped tables, see wavetable.h
+    PolyBlep,  // the naive formulas with polynomial corrections at the corners, see polyblep.h
+    Spectral   // harmonic series summed by one inverse FFT per hop for all voices, see spectral_bank.h
+};
+
+// oscillator phase is a 32-bit unsigned accumulator: one full cycle is 2^32,
+// so it wraps for free on overflow and never drifts the way a float phase does
+static constexpr double phase_cycle = 4294967296.0; // 2^32
+
+// per-sample accumulator step for a frequency; computed at note-on and when the sample rate changes
+inline uint32_t phaseIncrement(double frequency, double sample_rate)
+{
+    return static_cast<uint32_t>(std::llround(frequency / sample_rate * phase_cycle));
+}
+
+// the accumulator read as a sawtooth in [-1, 1): flipping the top bit and reading it signed
+// turns [0, 2^32) into [-2^31, 2^31)
+inline float sawFromPhase(uint32_t phase)
+{
+    return static_cast<float>(static_cast<int32_t>(phase ^ 0x80000000u)) * (1.0f / 2147483648.0f);
+}
+
+// sin(πt) for t in [-1, 1): fold onto [-½, ½] and use an odd polynomial (error < 4e-6)
+inline float sinPi(float t)
+{
+    const float folded = 0.5f - std::abs(std::abs(t) - 0.5f);
+    const float x = std::copysign(folded, t);
+    const float x2 = x * x;
+    return x * (3.14159265f + x2 * (-5.16771278f + x2 * (2.55016404f + x2 * (-0.599264529f + x2 * 0.0821458866f))));
+}
+
+// every waveform is a function of the sawtooth t = phase/π - 1
+template <WaveformType W>
+inline float waveFromPhase(uint32_t phase)
+{
+    const float t = sawFromPhase(phase);
+    if constexpr (W == WaveformType::Sine)
+        return -sinPi(t);                     // sin(phase) = -sin(πt)
+    else if constexpr (W == WaveformType::Sawtooth)
+        return t;
+    else if constexpr (W == WaveformType::Square)
+        return t < 0.0f ? 0.5f : -0.5f;       // first half of the cycle is +0.5
+    else
+        return std::abs(t) * 2.0f - 1.0f;
+}
+
+// same as above, simd::width phases at a time
+namespace simd
+{
+    inline vfloat sawFromPhase(vuint phase)
+    {
+        return mul(signedToFloat(bitXor(phase, broadcast(0x80000000u))), broadcast(1.0f / 2147483648.0f));
+    }
+
+    inline vfloat sinPi(vfloat t)
+    {
+        const vfloat half = broadcast(0.5f);
+        const vfloat x = bitXor(sub(half, abs(sub(abs(t), half))), signOf(t));
+        const vfloat x2 = mul(x, x);
+
+        vfloat p = broadcast(0.0821458866f);
+        p = add(mul(p, x2), broadcast(-0.599264529f));
+        p = add(mul(p, x2), broadcast(2.55016404f));
+        p = add(mul(p, x2), broadcast(-5.16771278f));
+        p = add(mul(p, x2), broadcast(3.14159265f));
+        return mul(p, x);
+    }
+
+    template <WaveformType W>
+    inline vfloat waveFromPhase(vuint phase)
+    {
+        const vfloat t = simd::sawFromPhase(phase);
+        if constexpr (W == WaveformType::Sine)
+            return bitXor(simd::sinPi(t), broadcast(-0.0f));
+        else if constexpr (W == WaveformType::Sawtooth)
+            return t;
+        else if constexpr (W == WaveformType::Square)
+            return bitXor(broadcast(-0.5f), signOf(t));
+        else
+            return sub(mul(abs(t), broadcast(2.0f)), broadcast(1.0f));
+    }
+}
+
+// oscillators are functors over simd::width lanes: (phase, phase increment, per-voice table offset) -> sample.
+// the analytic shapes need neither the increment nor tables
+template <WaveformType W>
+struct AnalyticOscillator
+{
+    simd::vfloat operator()(simd::vuint phase, simd::vuint /*increment*/, simd::vuint /*table_offset*/) const
+    {
+        return simd::waveFromPhase<W>(phase);
+    }
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include "oscillator.h"
+
+// the naive saw, square and triangle with their corners smoothed by two-sample polynomial residuals:
+// PolyBLEP at the steps, PolyBLAMP at the slope changes of the triangle. no tables and no oversampling,
+// and only mul/add/max per lane, so it vectorises across voices exactly like the analytic shapes
+template <WaveformType W>
+struct PolyBlepOscillator
+{
+    simd::vfloat operator()(simd::vuint phase, simd::vuint increment, simd::vuint /*table_offset*/) const
+    {
+        using namespace simd;
+        if constexpr (W == WaveformType::Sine)
+        {
+            return simd::waveFromPhase<W>(phase); // already band-limited
+        }
+        else
+        {
+            // a zero increment (idle padding lane) must not turn into inf·0
+            const vfloat dt = max(unitPhase(increment), broadcast(1.0f / 16777216.0f));
+            const vfloat inv_dt = div(broadcast(1.0f), dt);
+            const vfloat t = unitPhase(phase);
+
+            if constexpr (W == WaveformType::Sawtooth)
+            {
+                // falls by 2 at t = 0
+                return sub(sub(add(t, t), broadcast(1.0f)), blep(t, inv_dt));
+            }
+            else
+            {
+                const vfloat t_half = unitPhase(add(phase, broadcast(0x80000000u)));
+                const vfloat naive = simd::waveFromPhase<W>(phase);
+
+                if constexpr (W == WaveformType::Square)
+                {
+                    // rises by 1 at t = 0, falls by 1 at t = ½
+                    return add(naive, mul(broadcast(0.5f), sub(blep(t, inv_dt), blep(t_half, inv_dt))));
+                }
+                else
+                {
+                    // slope turns from +4 to -4 per cycle at t = 0 and back at t = ½, 8·dt per sample
+                    return add(naive, mul(mul(broadcast(8.0f), dt), sub(blamp(t_half, inv_dt), blamp(t, inv_dt))));
+                }
+            }
+        }
+    }
+
+private:
+    // top 24 bits of the accumulator as a position in [0, 1) of the cycle
+    static simd::vfloat unitPhase(simd::vuint phase)
+    {
+        return simd::mul(simd::signedToFloat(simd::shiftRight<8>(phase)), simd::broadcast(1.0f / 16777216.0f));
+    }
+
+    // 1 - distance in samples after (after) or before (before) a corner at t = 0; zero outside the window
+    static void window(simd::vfloat t, simd::vfloat inv_dt, simd::vfloat& after, simd::vfloat& before)
+    {
+        using namespace simd;
+        const vfloat one = broadcast(1.0f);
+        after  = max(sub(one, mul(t, inv_dt)), zero());
+        before = max(sub(one, mul(sub(one, t), inv_dt)), zero());
+    }
+
+    // residual of a unit-height step, scaled for a step of 2
+    static simd::vfloat blep(simd::vfloat t, simd::vfloat inv_dt)
+    {
+        using namespace simd;
+        vfloat after, before;
+        window(t, inv_dt, after, before);
+        return sub(mul(before, before), mul(after, after));
+    }
+
+    // integral of the step residual: residual of a slope change of 1 per sample
+    static simd::vfloat blamp(simd::vfloat t, simd::vfloat inv_dt)
+    {
+        using namespace simd;
+        vfloat after, before;
+        window(t, inv_dt, after, before);
+        return mul(add(mul(mul(after, after), after), mul(mul(before, before), before)), broadcast(1.0f / 6.0f));
+    }
+};
@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "wav_file.h"
+
+// records the output to a .wav file without the audio thread ever touching the file system or the heap.
+// the audio thread copies each block into a ring allocated by start(); a writer thread wakes every few
+// milliseconds and drains whatever is there to disk in large sequential writes. if the disk falls behind
+// and the ring fills up, whole blocks are dropped (and counted) rather than the audio thread waiting.
+// a .wav file can't hold more than 4 GiB; when it's full the recording stops by itself and isFull() says why.
+// start(), stop() and the counters are for the message thread, write() for the audio thread
+class Recorder
+{
+public:
+    ~Recorder() { stop(); }
+
+    // ring_secs of audio can wait for the disk before blocks are dropped
+    bool start(const std::string& path, double sample_rate, int num_channels, double ring_secs = 4.0)
+    {
+        stop();
+        if (num_channels <= 0 || !wav.open(path, static_cast<int>(sample_rate), num_channels))
+            return false;
+
+        channels = num_channels;
+        std::size_t frames = 1;
+        while (frames < static_cast<std::size_t>(ring_secs * sample_rate))
+            frames <<= 1;
+        ring.assign(frames * static_cast<std::size_t>(channels), 0.0f);
+        ring_frames = frames;
+        write_frame.store(0, std::memory_order_relaxed);
+        read_frame.store(0, std::memory_order_relaxed);
+        dropped.store(0, std::memory_order_relaxed);
+        full.store(false, std::memory_order_relaxed);
+
+        stopping.store(false, std::memory_order_relaxed);
+        writer = std::thread([this] { drain(); });
+        armed.store(true, std::memory_order_seq_cst);
+        return true;
+    }
+
+    // writes out what is still in the ring and closes the file
+    void stop()
+    {
+        if (!writer.joinable())
+            return;
+
+        // once armed is down and no write() is halfway through, nothing touches the ring but the writer
+        armed.store(false, std::memory_order_seq_cst);
+        while (writing.load(std::memory_order_seq_cst))
+            std::this_thread::yield();
+
+        stopping.store(true, std::memory_order_release);
+        writer.join();
+        wav.close();
+    }
+
+    bool isRecording() const         { return armed.load(std::memory_order_relaxed); }
+    // the file reached the .wav size limit and the recording stopped there
+    bool isFull() const              { return full.load(std::memory_order_relaxed); }
+    uint64_t recordedFrames() const  { return read_frame.load(std::memory_order_relaxed); }
+    // frames lost because the ring was full
+    uint64_t droppedFrames() const   { return dropped.load(std::memory_order_relaxed); }
+
+    // audio thread: queues one block of planar channels, or drops it whole if it doesn't fit
+    void write(const float* const* block, int num_channels, int num_samples)
+    {
+        writing.store(true, std::memory_order_seq_cst);
+        if (armed.load(std::memory_order_seq_cst) && num_samples > 0)
+            push(block, num_channels, num_samples);
+        writing.store(false, std::memory_order_release);
+    }
+
+private:
+    void push(const float* const* block, int num_channels, int num_samples)
+    {
+        const uint64_t head = write_frame.load(std::memory_order_relaxed);
+        const uint64_t free_frames = ring_frames - (head - read_frame.load(std::memory_order_acquire));
+        if (static_cast<uint64_t>(num_samples) > free_frames)
+        {
+            dropped.store(dropped.load(std::memory_order_relaxed) + static_cast<uint64_t>(num_samples), std::memory_order_relaxed);
+            return;
+        }
+
+        // a mono block goes to every channel of the file, missing channels are silent
+        for (int n = 0; n < num_samples; ++n)
+        {
+            float* frame = &ring[((head + static_cast<uint64_t>(n)) & (ring_frames - 1)) * static_cast<std::size_t>(channels)];
+            for (int channel = 0; channel < channels; ++channel)
+            {
+                const int source = num_channels == 1 ? 0 : channel;
+                frame[channel] = source < num_channels ? block[source][n] : 0.0f;
+            }
+        }
+        write_frame.store(head + static_cast<uint64_t>(num_samples), std::memory_order_release);
+    }
+
+    void drain()
+    {
+        for (;;)
+        {
+            // read stopping first: once it's set, the ring holds everything that will ever be written
+            const bool last = stopping.load(std::memory_order_acquire);
+            const uint64_t tail = read_frame.load(std::memory_order_relaxed);
+            const uint64_t head = write_frame.load(std::memory_order_acquire);
+
+            uint64_t at = tail;
+            while (at < head)
+            {
+                // up to the end of the ring in one go, the wrapped part in a second
+                const uint64_t offset = at & (ring_frames - 1);
+                const uint64_t count = std::min(head - at, ring_frames - offset);
+                if (!full.load(std::memory_order_relaxed) && !wav.write(&ring[offset * static_cast<std::size_t>(channels)], static_cast<int>(count)))
+                {
+                    // the rest of the ring and anything still on its way is thrown away
+                    full.store(true, std::memory_order_relaxed);
+                    armed.store(false, std::memory_order_seq_cst);
+                }
+                at += count;
+            }
+            read_frame.store(head, std::memory_order_release);
+
+            if (last)
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(drain_interval_ms));
+        }
+    }
+
+    static constexpr int drain_interval_ms = 50;
+
+    WavWriter wav;
+    std::thread writer;
+    std::vector<float> ring; // interleaved frames
+    uint64_t ring_frames = 0; // a power of two
+    int channels = 0;
+
+    alignas(64) std::atomic<uint64_t> write_frame{ 0 };
+    alignas(64) std::atomic<uint64_t> read_frame{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+    std::atomic<bool> armed{ false };
+    std::atomic<bool> full{ false };
+    std::atomic<bool> writing{ false };
+    std::atomic<bool> stopping{ false };
+};
@@ -0,0 +1,231 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "mapped_file.h"
+#include "melodies.h"
+#include "synth_engine.h"
+#include "wav_file.h"
+
+// everything that decides what a rendered melody sounds like
+struct RenderKey
+{
+    int melody = 0; // melodyCatalog() index
+    WaveformType waveform = WaveformType::Sine;
+    OscillatorMode oscillator_mode = OscillatorMode::Wavetable;
+    double sample_rate = 48000.0;
+    double tempo = 1.0;
+    int transpose = 0;
+    StealPolicy steal_policy = StealPolicy::Oldest; // which voices give way decides which notes are cut short
+    int polyphony = SynthEngine::default_polyphony;
+    uint32_t engine_version = synth_engine_version;
+
+    auto tied() const { return std::tie(melody, waveform, oscillator_mode, sample_rate, tempo, transpose, steal_policy, polyphony, engine_version); }
+    bool operator<(const RenderKey& other) const  { return tied() < other.tied(); }
+    bool operator==(const RenderKey& other) const { return tied() == other.tied(); }
+
+    // unique per key, and readable when browsing the spill directory
+    std::string fileName() const
+    {
+        return "melody" + std::to_string(melody) + "_w" + std::to_string(static_cast<int>(waveform)) + "_o" +
+               std::to_string(static_cast<int>(oscillator_mode)) + "_" + std::to_string(static_cast<long long>(sample_rate)) + "hz_t" +
+               std::to_string(static_cast<long long>(tempo * 1000.0)) + "_x" + std::to_string(transpose) + "_s" +
+               std::to_string(static_cast<int>(steal_policy)) + "_p" + std::to_string(polyphony) + "_v" + std::to_string(engine_version) + ".wav";
+    }
+};
+
+struct RenderedMelody
+{
+    RenderKey key;
+    std::vector<float> samples; // mono, output gain applied, ready to mix
+};
+
+// melodies rendered once and kept for replay. renders happen on the cache's own thread; the most recently
+// used ones stay in memory up to a byte budget, and the rest are written to the spill directory (if
+// there is one) when they're evicted, to be read back instead of re-rendered. entries are handed out
+// as shared_ptrs, so eviction never pulls a buffer out from under whoever is playing it.
+// message-thread API; nothing here is for the audio thread
+class RenderCache
+{
+public:
+    using Renderer = std::function<std::vector<float>(const RenderKey&)>;
+
+    RenderCache(Renderer render_melody, std::size_t max_bytes, std::filesystem::path spill = {})
+        : renderer(std::move(render_melody)), budget(max_bytes), spill_dir(std::move(spill))
+    {
+        if (!spill_dir.empty())
+        {
+            std::error_code error;
+            std::filesystem::create_directories(spill_dir, error);
+        }
+        worker = std::thread([this] { work(); });
+    }
+
+    ~RenderCache()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    RenderCache(const RenderCache&) = delete;
+    RenderCache& operator=(const RenderCache&) = delete;
+
+    // the render if it's in memory, or nullptr; O(log n), never touches the disk
+    std::shared_ptr<const RenderedMelody> find(const RenderKey& key)
+    {
+        std::lock_guard lock(mutex);
+        auto it = index.find(key);
+        if (it == index.end())
+            return nullptr;
+        entries.splice(entries.begin(), entries, it->second); // most recently used first
+        return *it->second;
+    }
+
+    // gets key into memory in the background, from the spill directory or by rendering it.
+    // repeated requests for the same key are only worked on once
+    void request(const RenderKey& key)
+    {
+        {
+            std::lock_guard lock(mutex);
+            if (index.count(key) != 0 || std::find(queue.begin(), queue.end(), key) != queue.end() || (busy && working_on == key))
+                return;
+            queue.push_back(key);
+        }
+        wake.notify_one();
+    }
+
+    std::size_t bytesInMemory() const
+    {
+        std::lock_guard lock(mutex);
+        return bytes;
+    }
+
+private:
+    static std::size_t sizeOf(const RenderedMelody& melody) { return melody.samples.size() * sizeof(float); }
+
+    void work()
+    {
+        std::unique_lock lock(mutex);
+        for (;;)
+        {
+            wake.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping)
+                return;
+            working_on = queue.front();
+            queue.pop_front();
+            busy = true;
+
+            lock.unlock();
+            auto melody = std::make_shared<RenderedMelody>();
+            melody->key = working_on;
+            if (!load(working_on, melody->samples))
+                melody->samples = renderer(working_on);
+            lock.lock();
+
+            busy = false;
+            const auto evicted = insert(std::move(melody));
+
+            // the disk is written with the lock released, so find() and request() never wait on it
+            lock.unlock();
+            for (const auto& old : evicted)
+                spill(*old);
+            lock.lock();
+        }
+    }
+
+    // with the lock held; returns what was evicted to make room, for the caller to spill
+    std::vector<std::shared_ptr<const RenderedMelody>> insert(std::shared_ptr<const RenderedMelody> melody)
+    {
+        bytes += sizeOf(*melody);
+        entries.push_front(std::move(melody));
+        index[entries.front()->key] = entries.begin();
+
+        std::vector<std::shared_ptr<const RenderedMelody>> evicted;
+        while (bytes > budget && entries.size() > 1)
+        {
+            bytes -= sizeOf(*entries.back());
+            index.erase(entries.back()->key);
+            evicted.push_back(std::move(entries.back()));
+            entries.pop_back();
+        }
+        return evicted;
+    }
+
+    void spill(const RenderedMelody& melody) const
+    {
+        if (spill_dir.empty())
+            return;
+        const auto path = spill_dir / melody.key.fileName();
+        std::error_code error;
+        if (std::filesystem::exists(path, error))
+            return;
+
+        // written under a temporary name first, so until the rename load() sees a spill in progress as a miss
+        const auto partial = path.string() + ".part";
+        WavWriter wav;
+        if (!wav.open(partial, static_cast<int>(melody.key.sample_rate), 1))
+            return;
+        wav.write(melody.samples.data(), static_cast<int>(melody.samples.size()));
+        wav.close();
+        std::filesystem::rename(partial, path, error);
+    }
+
+    // a spilled render, as WavWriter wrote it: 44-byte header, mono 32-bit float
+    bool load(const RenderKey& key, std::vector<float>& samples) const
+    {
+        if (spill_dir.empty())
+            return false;
+        MappedFile file;
+        if (!file.open((spill_dir / key.fileName()).string(), true) || file.size() < 44)
+            return false;
+
+        const uint8_t* header = file.data();
+        const bool is_mono_float = header[20] == 3 && header[22] == 1 && header[34] == 32;
+        if (std::memcmp(header, "RIFF", 4) != 0 || std::memcmp(header + 36, "data", 4) != 0 || !is_mono_float)
+            return false;
+
+        samples.resize((file.size() - 44) / sizeof(float));
+        std::memcpy(samples.data(), header + 44, samples.size() * sizeof(float));
+        return true;
+    }
+
+    Renderer renderer;
+    std::size_t budget;
+    std::filesystem::path spill_dir;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::list<std::shared_ptr<const RenderedMelody>> entries; // most recently used first
+    std::map<RenderKey, std::list<std::shared_ptr<const RenderedMelody>>::iterator> index;
+    std::size_t bytes = 0;
+    std::deque<RenderKey> queue;
+    RenderKey working_on;
+    bool busy = false;
+    bool stopping = false;
+
+    std::thread worker;
+};
+
+// the usual RenderCache::Renderer: key.melody indexes melodyCatalog(), played on the computer keyboard's notes
+inline std::vector<float> renderCatalogMelody(const RenderKey& key)
+{
+    const MelodyEntry& melody = melodyCatalog()[static_cast<std::size_t>(key.melody)];
+    return renderOffline(CompiledScore(melody.notes, keyboardNoteMap()),
+                         { key.waveform, key.oscillator_mode, key.sample_rate, key.tempo, key.transpose, key.steal_policy, key.polyphony });
+}
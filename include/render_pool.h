@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "rt_check.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// a few threads spawned up front that the audio thread fans a block's work out to and waits for.
+// no locks and no allocation per block: the caller publishes the task by bumping a generation
+// counter, works on share 0 itself, and spins until the workers have counted themselves out.
+// workers spin for a short while after each block before they sleep on the counter, so back-to-back
+// blocks don't pay for a wake-up
+class RenderPool
+{
+public:
+    explicit RenderPool(int num_workers)
+    {
+        threads.reserve(static_cast<std::size_t>(num_workers));
+        for (int i = 0; i < num_workers; ++i)
+            threads.emplace_back([this, i] { workerLoop(i + 1); });
+    }
+
+    ~RenderPool()
+    {
+        stopping.store(true, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+        generation.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    RenderPool(const RenderPool&) = delete;
+    RenderPool& operator=(const RenderPool&) = delete;
+
+    // shares of work per run(), including the calling thread's
+    int size() const { return static_cast<int>(threads.size()) + 1; }
+
+    // calls task(share) for every share in [0, size()) and returns once all of them are done.
+    // share 0 runs on the calling thread
+    template <typename Task>
+    void run(Task& task)
+    {
+        context = &task;
+        invoke = [](void* target, int share) { (*static_cast<Task*>(target))(share); };
+        remaining.store(static_cast<int>(threads.size()), std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+        generation.notify_all();
+
+        task(0);
+        while (remaining.load(std::memory_order_acquire) != 0)
+            pause();
+    }
+
+private:
+    static void pause()
+    {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    // the workers are part of the audio path, so they ask for the same real-time class it runs in.
+    // without the privilege this quietly stays a normal thread
+    static void raisePriority()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        sched_param param{};
+        param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+    }
+
+    void workerLoop(int share)
+    {
+        raisePriority();
+        uint64_t seen = 0;
+        for (;;)
+        {
+            uint64_t now = generation.load(std::memory_order_acquire);
+            for (int spin = 0; now == seen && spin < spin_count; ++spin)
+            {
+                pause();
+                now = generation.load(std::memory_order_acquire);
+            }
+            if (now == seen)
+            {
+                generation.wait(seen, std::memory_order_acquire);
+                continue;
+            }
+            seen = now;
+
+            if (stopping.load(std::memory_order_relaxed))
+                return;
+            rtcheck::AudioScope audio_scope;
+            invoke(context, share);
+            remaining.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    static constexpr int spin_count = 4096;
+
+    std::vector<std::thread> threads;
+    void* context = nullptr;
+    void (*invoke)(void*, int) = nullptr;
+    alignas(64) std::atomic<uint64_t> generation{ 0 };
+    alignas(64) std::atomic<int> remaining{ 0 };
+    std::atomic<bool> stopping{ false };
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+
+// real-time safety checking for debug builds. configure with -DSYNTH_RT_CHECK=ON and every thread
+// inside an AudioScope has its calls to malloc/free, pthread mutex, rwlock and condition variable
+// waits, semaphore waits, sleeps and file I/O reported on stderr with a stack trace (src/rt_check.cpp interposes them).
+// set SYNTH_RT_CHECK_ABORT=1 in the environment to abort on the first one instead, e.g. under a
+// debugger. without the option all of this compiles to nothing
+namespace rtcheck
+{
+#if SYNTH_RT_CHECK
+    inline constexpr bool enabled = true;
+
+    void enterAudioThread();
+    void leaveAudioThread();
+    // violations seen so far, on any thread
+    uint64_t violations();
+#else
+    inline constexpr bool enabled = false;
+
+    inline void enterAudioThread() {}
+    inline void leaveAudioThread() {}
+    inline uint64_t violations() { return 0; }
+#endif
+
+    // marks the current thread as real-time for as long as it lives; scopes nest
+    struct AudioScope
+    {
+        AudioScope() { enterAudioThread(); }
+        ~AudioScope() { leaveAudioThread(); }
+        AudioScope(const AudioScope&) = delete;
+        AudioScope& operator=(const AudioScope&) = delete;
+    };
+}
@@ -0,0 +1,557 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "envelope.h"
+#include "mapped_file.h"
+#include "midi_file.h"
+#include "voice_slots.h"
+
+// one recorded note: a memory-mapped .wav (16/24/32-bit PCM or 32-bit float, any channel count, mixed
+// down to mono) and the pitch it was recorded at. only the first preload frames are decoded into memory
+// up front; the rest stays on disk until a Sampler streams it
+class SampleZone
+{
+public:
+    bool open(const std::string& path, int root_note, std::size_t preload_frames)
+    {
+        if (!file.open(path, true))
+            return fail("can't open " + path);
+        if (!parseWav())
+            return fail(path + " is not a PCM or float .wav file");
+
+        if (root_note < 0)
+            root_note = unity_note >= 0 ? unity_note : 60;
+        root_frequency = midiNoteFrequency(root_note);
+
+        attack.resize(std::min<std::size_t>(preload_frames, frames));
+        decode(0, attack.size(), attack.data());
+        file.dontNeed(data_offset, attack.size() * frame_bytes);
+        return true;
+    }
+
+    // frames [first, first + count) as mono floats. reads the mapping, so prefetch thread only
+    void decode(std::size_t first, std::size_t count, float* out) const
+    {
+        const uint8_t* in = file.data() + data_offset + first * frame_bytes;
+        const float scale = 1.0f / static_cast<float>(channels);
+        for (std::size_t frame = 0; frame < count; ++frame, in += frame_bytes)
+        {
+            float sum = 0.0f;
+            for (int channel = 0; channel < channels; ++channel)
+                sum += readSample(in + channel * sample_bytes);
+            out[frame] = sum * scale;
+        }
+    }
+
+    // streaming residency hints, in frames
+    void willNeed(std::size_t first, std::size_t count) const { file.willNeed(data_offset + first * frame_bytes, count * frame_bytes); }
+    void dontNeed(std::size_t first, std::size_t count) const { file.dontNeed(data_offset + first * frame_bytes, count * frame_bytes); }
+
+    std::size_t numFrames() const         { return frames; }
+    double sampleRate() const             { return file_rate; }
+    float rootFrequency() const           { return root_frequency; }
+    const std::vector<float>& attackFrames() const { return attack; }
+    const std::string& error() const      { return error_text; }
+
+private:
+    static uint32_t read16(const uint8_t* data) { return data[0] | data[1] << 8; }
+    static uint32_t read32(const uint8_t* data) { return data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24; }
+
+    float readSample(const uint8_t* in) const
+    {
+        if (is_float)
+        {
+            float value;
+            std::memcpy(&value, in, sizeof(value));
+            return value;
+        }
+        switch (sample_bytes)
+        {
+        case 1:  return (static_cast<float>(in[0]) - 128.0f) * (1.0f / 128.0f); // 8-bit is unsigned
+        case 2:  return static_cast<float>(static_cast<int16_t>(read16(in))) * (1.0f / 32768.0f);
+        case 3:  return static_cast<float>(static_cast<int32_t>(in[0] << 8 | in[1] << 16 | static_cast<uint32_t>(in[2]) << 24) >> 8) * (1.0f / 8388608.0f);
+        default: return static_cast<float>(static_cast<int32_t>(read32(in))) * (1.0f / 2147483648.0f);
+        }
+    }
+
+    // walks the RIFF chunks for "fmt ", "data" and, if there is one, the unity note in "smpl"
+    bool parseWav()
+    {
+        const uint8_t* data = file.data();
+        const std::size_t size = file.size();
+        if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0)
+            return false;
+
+        bool has_format = false;
+        std::size_t data_bytes = 0;
+        for (std::size_t at = 12; at + 8 <= size;)
+        {
+            const uint8_t* chunk = data + at;
+            const std::size_t length = std::min<std::size_t>(read32(chunk + 4), size - at - 8);
+            if (std::memcmp(chunk, "fmt ", 4) == 0 && length >= 16)
+            {
+                uint32_t format = read16(chunk + 8);
+                if (format == 0xFFFE && length >= 40)
+                    format = read16(chunk + 32); // WAVE_FORMAT_EXTENSIBLE: the subformat GUID starts with the tag
+                channels = static_cast<int>(read16(chunk + 10));
+                file_rate = read32(chunk + 12);
+                sample_bytes = static_cast<int>(read16(chunk + 22)) / 8;
+                is_float = format == 3;
+                has_format = (format == 1 && sample_bytes >= 1 && sample_bytes <= 4) || (is_float && sample_bytes == 4);
+            }
+            else if (std::memcmp(chunk, "data", 4) == 0)
+            {
+                data_offset = at + 8;
+                data_bytes = length;
+            }
+            else if (std::memcmp(chunk, "smpl", 4) == 0 && length >= 16)
+            {
+                unity_note = static_cast<int>(std::min<uint32_t>(read32(chunk + 8 + 12), 127));
+            }
+            at += 8 + length + (length & 1); // chunks are padded to an even size
+        }
+
+        if (!has_format || channels <= 0 || file_rate <= 0.0 || data_offset == 0)
+            return false;
+        frame_bytes = static_cast<std::size_t>(channels * sample_bytes);
+        frames = data_bytes / frame_bytes;
+        return frames > 1;
+    }
+
+    bool fail(std::string text)
+    {
+        error_text = std::move(text);
+        file.close();
+        return false;
+    }
+
+    MappedFile file;
+    std::size_t data_offset = 0;
+    std::size_t frames = 0;
+    std::size_t frame_bytes = 0;
+    int channels = 0;
+    int sample_bytes = 0;
+    bool is_float = false;
+    double file_rate = 0.0;
+    int unity_note = -1;
+    float root_frequency = 0.0f;
+    std::vector<float> attack;
+    std::string error_text;
+};
+
+// the sampled instrument: zones sorted by pitch, each note played from the zone recorded nearest to it
+// and repitched from there, so every key of the note map sounds whatever notes were sampled.
+// built during setup and read-only afterwards
+class SampleSet
+{
+public:
+    // frames of every zone held in memory, enough to cover the prefetch thread getting a stream going
+    static constexpr std::size_t default_preload_frames = 16384;
+
+    explicit SampleSet(std::size_t preload_frames = default_preload_frames) : preload(preload_frames) {}
+
+    // root_note is the MIDI note the file was recorded at; -1 takes it from the file's name, then from
+    // its smpl chunk, then assumes middle C
+    bool addFile(const std::string& path, int root_note = -1)
+    {
+        auto zone = std::make_unique<SampleZone>();
+        if (root_note < 0)
+            root_note = noteFromName(std::filesystem::path(path).stem().string());
+        if (!zone->open(path, root_note, preload))
+        {
+            error_text = zone->error();
+            return false;
+        }
+
+        const auto at = std::upper_bound(zones.begin(), zones.end(), zone->rootFrequency(),
+                                         [](float frequency, const auto& other) { return frequency < other->rootFrequency(); });
+        zones.insert(at, std::move(zone));
+        return true;
+    }
+
+    // every .wav in the directory, named by the note they hold: "piano_60.wav", "piano_C4.wav", "F#3.wav"
+    bool addDirectory(const std::string& path)
+    {
+        std::error_code error;
+        std::vector<std::filesystem::path> files;
+        for (const auto& entry : std::filesystem::directory_iterator(path, error))
+        {
+            auto extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (entry.is_regular_file() && extension == ".wav")
+                files.push_back(entry.path());
+        }
+        if (error || files.empty())
+        {
+            error_text = "no .wav files in " + path;
+            return false;
+        }
+
+        std::sort(files.begin(), files.end());
+        for (const auto& file : files)
+            if (!addFile(file.string()))
+                return false;
+        return true;
+    }
+
+    // the zone nearest in pitch, in O(log n); nullptr when empty
+    const SampleZone* zoneFor(float frequency) const
+    {
+        if (zones.empty())
+            return nullptr;
+        const auto above = std::lower_bound(zones.begin(), zones.end(), frequency,
+                                            [](const auto& zone, float f) { return zone->rootFrequency() < f; });
+        if (above == zones.begin())
+            return above->get();
+        if (above == zones.end())
+            return zones.back().get();
+        const auto below = above - 1;
+        // nearest in semitones, not hertz
+        return frequency * frequency < (*below)->rootFrequency() * (*above)->rootFrequency() ? below->get() : above->get();
+    }
+
+    bool empty() const                { return zones.empty(); }
+    std::size_t size() const          { return zones.size(); }
+    const std::string& error() const  { return error_text; }
+
+    // "60", "piano_60", "C4", "piano-F#3", "Bb2", "C#-1": the note at the end of a file name, or -1
+    static constexpr int noteFromName(std::string_view name)
+    {
+        std::size_t digits = name.size();
+        while (digits > 0 && name[digits - 1] >= '0' && name[digits - 1] <= '9')
+            --digits;
+        if (digits == name.size())
+            return -1;
+        int number = 0;
+        for (std::size_t i = digits; i < name.size(); ++i)
+            number = std::min(number * 10 + (name[i] - '0'), 1000); // long runs of digits can't overflow
+
+        // a minus sign belongs to the octave only when a note comes before it: "C-1", but "piano-60"
+        std::size_t letter = digits;
+        const bool minus = letter > 0 && name[letter - 1] == '-';
+        if (minus)
+            --letter;
+        int accidental = 0;
+        if (letter >= 2 && (name[letter - 1] == '#' || name[letter - 1] == 'b') && isNoteLetter(name[letter - 2]))
+            accidental = name[--letter] == '#' ? 1 : -1;
+
+        if (letter > 0 && isNoteLetter(name[letter - 1]) && (letter == 1 || !isLetter(name[letter - 2])))
+        {
+            constexpr int semitones[] = { 9, 11, 0, 2, 4, 5, 7 }; // A to G
+            const int octave = minus ? -number : number;
+            const int note = (octave + 1) * 12 + semitones[(name[letter - 1] & ~0x20) - 'A'] + accidental;
+            return note >= 0 && note <= 127 ? note : -1;
+        }
+        return number <= 127 ? number : -1;
+    }
+
+private:
+    static constexpr bool isLetter(char c)     { return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'); }
+    static constexpr bool isNoteLetter(char c) { return (c >= 'A' && c <= 'G') || (c >= 'a' && c <= 'g'); }
+
+    std::size_t preload;
+    std::vector<std::unique_ptr<SampleZone>> zones;
+    std::string error_text;
+};
+
+static_assert(SampleSet::noteFromName("C-1") == 0 && SampleSet::noteFromName("C#-1") == 1);
+static_assert(SampleSet::noteFromName("F#3") == 54 && SampleSet::noteFromName("Bb2") == 46 && SampleSet::noteFromName("piano_C4") == 60);
+static_assert(SampleSet::noteFromName("piano_60") == 60 && SampleSet::noteFromName("piano-60") == 60 && SampleSet::noteFromName("piano") == -1);
+
+// plays a SampleSet as a voice type of its own. each voice starts from its zone's preloaded attack and
+// carries on from a ring that a prefetch thread keeps filled from the mapped file, a few thousand frames
+// ahead of the voice, so only the attacks and the rings are ever resident and the audio thread never
+// touches the mapping. if the disk can't keep up the voice goes silent rather than wait (counted in
+// underruns()). samples bring their own attack, so the envelope only shapes the release.
+// prepare() and the note/render functions are for the audio thread, underruns() for any thread
+class Sampler
+{
+public:
+    static constexpr std::size_t ring_frames = 16384; // per voice, a power of two
+
+    ~Sampler() { stopPrefetching(); }
+
+    // setup: the set must outlive the sampler
+    void setSampleSet(const SampleSet* samples) { set = samples; }
+    bool hasSamples() const                     { return set != nullptr && !set->empty(); }
+
+    void prepare(double new_sample_rate, int polyphony, const AdsrParams& params)
+    {
+        stopPrefetching();
+        sample_rate = new_sample_rate;
+        slots.prepare(hasSamples() ? polyphony : 0, sample_rate, { 0.0f, 0.0f, 1.0f, params.release_secs });
+
+        voices.reset();
+        if (slots.size() == 0)
+            return;
+        voices = std::make_unique<Voice[]>(static_cast<std::size_t>(slots.size()));
+        for (int v = 0; v < slots.size(); ++v)
+            voices[v].ring.assign(ring_frames, 0.0f);
+        prefetching.store(true, std::memory_order_relaxed);
+        prefetcher = std::thread([this] { prefetch(); });
+    }
+
+    void noteOn(int key, float frequency)
+    {
+        const int v = slots.noteOn(key);
+        if (v < 0)
+            return;
+
+        Voice& voice = voices[v];
+        const SampleZone* zone = set->zoneFor(frequency);
+        voice.zone = zone;
+        voice.position = 0.0;
+        voice.step = frequency / zone->rootFrequency() * zone->sampleRate() / sample_rate;
+
+        // the stream restarts at the end of the attack. the zone is published before the generation
+        // that tells the prefetch thread to look at it
+        voice.streaming.store(zone, std::memory_order_relaxed);
+        voice.consumed.store(pack(++voice.generation, zone->attackFrames().size()), std::memory_order_release);
+        note_ons.fetch_add(1, std::memory_order_release); // wakes the prefetch thread if nothing was streaming
+        note_ons.notify_one();
+    }
+
+    void noteOff(int key) { slots.noteOff(key); }
+
+    // adds every sounding voice into mix
+    void render(float* mix, int num_samples)
+    {
+        for (int v = 0; v < slots.size(); ++v)
+            if (slots.isSounding(v))
+                renderVoice(v, mix, num_samples);
+    }
+
+    // offline rendering, on the thread that calls render(): true once every voice's ring holds what the
+    // next num_samples need, so a render never depends on how quickly the prefetch thread got there
+    bool isStreamedAhead(int num_samples) const
+    {
+        for (int v = 0; v < slots.size(); ++v)
+        {
+            if (!slots.isSounding(v))
+                continue;
+            const Voice& voice = voices[v];
+            const std::size_t needed = std::min(static_cast<std::size_t>(voice.position + voice.step * num_samples) + 2, voice.zone->numFrames());
+            const uint64_t filled = voice.filled.load(std::memory_order_acquire);
+            const std::size_t available = generationOf(filled) == voice.generation ? frameOf(filled) : voice.zone->attackFrames().size();
+            const bool ring_full = available - std::min(available, static_cast<std::size_t>(voice.position)) >= ring_frames;
+            if (needed > available && !ring_full)
+                return false;
+        }
+        return true;
+    }
+
+    // times a voice ran out of streamed audio because the disk was too slow
+    uint64_t underruns() const { return underrun_count.load(std::memory_order_relaxed); }
+
+private:
+    // consumed and filled pack a generation (bumped at every note-on) above a frame number, so neither
+    // side ever acts on the other's view of a note the voice has already moved on from
+    static constexpr int frame_bits = 48;
+    static uint64_t pack(uint16_t generation, std::size_t frame) { return static_cast<uint64_t>(generation) << frame_bits | frame; }
+    static uint16_t generationOf(uint64_t packed)                { return static_cast<uint16_t>(packed >> frame_bits); }
+    static std::size_t frameOf(uint64_t packed)                  { return static_cast<std::size_t>(packed & ((uint64_t{ 1 } << frame_bits) - 1)); }
+
+    static constexpr int gain_chunk = 256;
+
+    struct Voice
+    {
+        // audio thread
+        const SampleZone* zone = nullptr;
+        double position = 0.0; // in the zone's frames
+        double step = 0.0;
+        uint16_t generation = 0;
+
+        // shared with the prefetch thread. the ring holds frames from the end of the attack onwards,
+        // frame f at ring[f % ring_frames]
+        std::atomic<const SampleZone*> streaming{ nullptr };
+        std::atomic<uint64_t> consumed{ 0 }; // first frame the voice may still read
+        std::atomic<uint64_t> filled{ 0 };   // frames streamed so far, attack included
+        std::vector<float> ring;
+
+        // prefetch thread: the zone's pages before this frame have been let go
+        std::size_t released = 0;
+    };
+
+    // linear interpolation between frames, under the envelope, until the streamed frames run out
+    void renderVoice(int v, float* mix, int num_samples)
+    {
+        Voice& voice = voices[v];
+        const float* attack = voice.zone->attackFrames().data();
+        const std::size_t attack_size = voice.zone->attackFrames().size();
+        const float* ring = voice.ring.data();
+        const uint64_t filled = voice.filled.load(std::memory_order_acquire);
+        const std::size_t available = std::min(generationOf(filled) == voice.generation ? frameOf(filled) : attack_size, voice.zone->numFrames());
+        const bool streamed_to_end = available == voice.zone->numFrames();
+
+        double position = voice.position;
+        const double step = voice.step;
+        bool starved = false;
+        float gain[gain_chunk];
+        for (int done = 0; done < num_samples;)
+        {
+            const int chunk = std::min(num_samples - done, gain_chunk);
+            const int sounding = slots.envelopeGain(v, gain, chunk);
+            int sample = 0;
+            for (; !starved && sample < sounding; ++sample)
+            {
+                const auto frame = static_cast<std::size_t>(position);
+                if (frame + 1 >= available)
+                    break;
+                const float a = frame < attack_size ? attack[frame] : ring[frame & (ring_frames - 1)];
+                const float b = frame + 1 < attack_size ? attack[frame + 1] : ring[(frame + 1) & (ring_frames - 1)];
+                const float fraction = static_cast<float>(position - static_cast<double>(frame));
+                mix[done + sample] += (a + (b - a) * fraction) * gain[sample];
+                position += step;
+            }
+
+            if (sample < sounding)
+            {
+                if (streamed_to_end)
+                {
+                    slots.stop(v); // the recording is over
+                    break;
+                }
+                // the stream is behind: silence until the next block, but the note keeps its time
+                if (!starved)
+                    underrun_count.fetch_add(1, std::memory_order_relaxed);
+                starved = true;
+                position += step * (sounding - sample);
+            }
+            if (sounding < chunk)
+                break; // released or faded out
+            done += chunk;
+        }
+
+        voice.position = position;
+        if (slots.isSounding(v))
+        {
+            voice.consumed.store(pack(voice.generation, static_cast<std::size_t>(position)), std::memory_order_release);
+        }
+        else
+        {
+            voice.streaming.store(nullptr, std::memory_order_relaxed);
+            voice.consumed.store(pack(++voice.generation, 0), std::memory_order_release);
+        }
+    }
+
+    // the prefetch thread: tops up every streaming voice's ring in turn, sleeping a millisecond when all
+    // are full, and until the next note-on when no voice is streaming at all
+    void prefetch()
+    {
+        for (;;)
+        {
+            // read before the voices and the flag: a note-on or stop after this either shows up below
+            // or makes wait() return
+            const uint32_t seen = note_ons.load(std::memory_order_acquire);
+            if (!prefetching.load(std::memory_order_relaxed))
+                return;
+            bool busy = false;
+            bool streaming = false;
+            for (int v = 0; v < slots.size(); ++v)
+            {
+                busy |= fill(v);
+                streaming |= voices[v].streaming.load(std::memory_order_relaxed) != nullptr;
+            }
+            if (!streaming)
+                note_ons.wait(seen, std::memory_order_acquire);
+            else if (!busy)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // true if it streamed anything
+    bool fill(int v)
+    {
+        Voice& voice = voices[v];
+        const uint64_t consumed = voice.consumed.load(std::memory_order_acquire);
+        const SampleZone* zone = voice.streaming.load(std::memory_order_relaxed);
+        if (zone == nullptr)
+            return false;
+
+        const uint16_t generation = generationOf(consumed);
+        const std::size_t start = zone->attackFrames().size();
+        const uint64_t filled = voice.filled.load(std::memory_order_relaxed);
+        const std::size_t written = generationOf(filled) == generation ? frameOf(filled) : start;
+        if (generationOf(filled) != generation)
+            voice.released = start;
+        const std::size_t read = std::max(frameOf(consumed), start);
+        const std::size_t count = std::min({ ring_frames - (written - std::min(read, written)), zone->numFrames() - written, chunk_frames });
+        if (count == 0)
+        {
+            if (generationOf(filled) != generation)
+                voice.filled.store(pack(generation, written), std::memory_order_release);
+            return false;
+        }
+
+        // in up to two pieces, where the ring wraps
+        for (std::size_t done = 0; done < count;)
+        {
+            const std::size_t at = (written + done) & (ring_frames - 1);
+            const std::size_t piece = std::min(count - done, ring_frames - at);
+            zone->decode(written + done, piece, voice.ring.data() + at);
+            done += piece;
+        }
+        zone->willNeed(written + count, chunk_frames);
+        voice.filled.store(pack(generation, written + count), std::memory_order_release);
+
+        // pages copied into the ring can go, but only once every other voice on the zone has them too
+        const std::size_t slowest = slowestOn(zone, written + count);
+        if (slowest > voice.released)
+        {
+            zone->dontNeed(voice.released, slowest - voice.released);
+            voice.released = slowest;
+        }
+        return true;
+    }
+
+    // the least any voice streaming zone has read from it, at most limit. a voice whose note-on the
+    // prefetch thread hasn't picked up yet starts over from the end of the attack
+    std::size_t slowestOn(const SampleZone* zone, std::size_t limit) const
+    {
+        std::size_t slowest = limit;
+        for (int v = 0; v < slots.size(); ++v)
+        {
+            const Voice& voice = voices[v];
+            const uint64_t consumed = voice.consumed.load(std::memory_order_acquire);
+            if (voice.streaming.load(std::memory_order_relaxed) != zone)
+                continue;
+            const uint64_t filled = voice.filled.load(std::memory_order_relaxed);
+            slowest = std::min(slowest, generationOf(filled) == generationOf(consumed) ? frameOf(filled) : zone->attackFrames().size());
+        }
+        return slowest;
+    }
+
+    void stopPrefetching()
+    {
+        prefetching.store(false, std::memory_order_relaxed);
+        note_ons.fetch_add(1, std::memory_order_release);
+        note_ons.notify_one();
+        if (prefetcher.joinable())
+            prefetcher.join();
+    }
+
+    static constexpr std::size_t chunk_frames = 4096; // per voice per pass, so one voice can't hold up the rest
+
+    const SampleSet* set = nullptr;
+    double sample_rate = 44100.0;
+
+    // audio thread, apart from what the prefetch thread reads through the atomics in each voice
+    VoiceSlots slots;
+    std::unique_ptr<Voice[]> voices; // one per slot
+
+    std::thread prefetcher;
+    std::atomic<bool> prefetching{ false };
+    std::atomic<uint32_t> note_ons{ 0 }; // bumped by every note-on, for the prefetch thread to sleep on
+    std::atomic<uint64_t> underrun_count{ 0 };
+};
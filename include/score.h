@@ -0,0 +1,125 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <vector>
+#include "notes.h"
+#include "voice.h"
+
+// one note-on or note-off of a compiled melody
+struct ScoreEvent
+{
+    double time_secs = 0.0;
+    int key_code     = -1;
+    float frequency  = 0.0f;
+    bool is_on       = false;
+};
+
+// a melody flattened into time-sorted on/off events with the frequencies already looked up, plus two
+// indexes over time: the sorted events themselves (binary search: where does playback resume after a seek)
+// and an interval tree over the notes (which notes are sounding at that moment). built once, read-only after,
+// so the audio thread can use it without locking
+class CompiledScore
+{
+public:
+    CompiledScore() = default;
+
+    // times stay as written; tempo is the sequencer's business
+    CompiledScore(std::span<const MelodyNote> melody, const std::map<int, Note>& note_map)
+    {
+        notes.reserve(melody.size());
+        for (const auto& note : melody)
+        {
+            auto it = note_map.find(note.keyCode);
+            if (it == note_map.end())
+                continue;
+
+            const double start = note.startTimeSecs;
+            const double end = start + note.durationSecs;
+            notes.push_back({ start, end, end, note.keyCode, it->second.frequency });
+        }
+
+        event_list.reserve(notes.size() * 2);
+        for (const auto& note : notes)
+        {
+            event_list.push_back({ note.start, note.key_code, note.frequency, true });
+            event_list.push_back({ note.end, note.key_code, note.frequency, false });
+        }
+        // at equal times offs come first, so a note that ends exactly where the same key starts again retriggers
+        std::stable_sort(event_list.begin(), event_list.end(), [](const ScoreEvent& a, const ScoreEvent& b) {
+            return a.time_secs < b.time_secs || (a.time_secs == b.time_secs && !a.is_on && b.is_on);
+        });
+
+        std::stable_sort(notes.begin(), notes.end(), [](const Interval& a, const Interval& b) { return a.start < b.start; });
+        buildMaxEnd(0, notes.size());
+    }
+
+    const std::vector<ScoreEvent>& events() const { return event_list; }
+    std::size_t numNotes() const                  { return notes.size(); }
+    double lengthSecs() const                     { return event_list.empty() ? 0.0 : event_list.back().time_secs; }
+
+    // index of the first event at or after secs, O(log n)
+    std::size_t firstEventAt(double secs) const
+    {
+        auto it = std::lower_bound(event_list.begin(), event_list.end(), secs,
+                                   [](const ScoreEvent& e, double t) { return e.time_secs < t; });
+        return static_cast<std::size_t>(it - event_list.begin());
+    }
+
+    // calls fn(ScoreEvent note_on) for every note with start < secs <= end, i.e. every note whose on-event
+    // lies before firstEventAt(secs) and whose off-event doesn't. O(log n + notes found), no allocation
+    template <typename Fn>
+    void forEachSoundingAt(double secs, Fn&& fn) const
+    {
+        stab(0, notes.size(), secs, fn);
+    }
+
+private:
+    struct Interval
+    {
+        double start   = 0.0;
+        double end     = 0.0;
+        double max_end = 0.0; // latest end anywhere in the subtree rooted here
+        int key_code   = -1;
+        float frequency = 0.0f;
+    };
+
+    // the notes, sorted by start, double as a balanced search tree: the middle of [lo, hi) is the root
+    // of that range. each root remembers the latest end below it, so whole subtrees that finished
+    // before the query time are skipped
+    double buildMaxEnd(std::size_t lo, std::size_t hi)
+    {
+        if (lo >= hi)
+            return -1.0;
+
+        const std::size_t mid = lo + (hi - lo) / 2;
+        auto& node = notes[mid];
+        node.max_end = std::max({ node.end, buildMaxEnd(lo, mid), buildMaxEnd(mid + 1, hi) });
+        return node.max_end;
+    }
+
+    template <typename Fn>
+    void stab(std::size_t lo, std::size_t hi, double secs, Fn& fn) const
+    {
+        if (lo >= hi)
+            return;
+
+        const std::size_t mid = lo + (hi - lo) / 2;
+        const auto& node = notes[mid];
+        if (node.max_end < secs)
+            return;
+
+        stab(lo, mid, secs, fn);
+        if (node.start < secs)
+        {
+            if (node.end >= secs)
+                fn(ScoreEvent{ node.start, node.key_code, node.frequency, true });
+            // everything to the right starts no earlier than this node
+            stab(mid + 1, hi, secs, fn);
+        }
+    }
+
+    std::vector<ScoreEvent> event_list;
+    std::vector<Interval> notes;
+};
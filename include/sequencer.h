@@ -0,0 +1,351 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include "event_queue.h"
+#include "score.h"
+#include "voice_allocator.h"
+
+// score events that arrive while playing instead of being compiled up front, e.g. decoded from a file by
+// a loader thread (MidiStream). the producer pushes them in time order and sets complete after the last.
+// an event that arrives after its time is played late, at the start of the next block
+struct ScoreStream
+{
+    SpscQueue<ScoreEvent, 4096> events;
+    std::atomic<bool> complete{ false };
+    // score time of the last event pushed, for a renderer with no deadline to wait on
+    std::atomic<double> pushed_secs{ 0.0 };
+
+    // nothing before score time secs can still be missing
+    bool hasEventsUntil(double secs) const
+    {
+        return complete.load(std::memory_order_acquire) || pushed_secs.load(std::memory_order_acquire) > secs;
+    }
+};
+
+// message thread -> audio thread requests for the sequencer
+struct SequencerCommand
+{
+    enum class Type : uint8_t
+    {
+        Play,    // score from the start, at tempo and transposed by transpose semitones
+        PlayStream, // stream, the same way
+        Stop,
+        Pause,
+        Resume,
+        Seek,    // to secs
+        SetLoop  // [secs, loop_end), loop_end <= secs clears the loop
+    };
+
+    Type type       = Type::Stop;
+    int score       = 0;
+    double secs     = 0.0;  // score time, as written
+    double loop_end = 0.0;
+    double tempo    = 1.0;
+    int transpose   = 0;
+    ScoreStream* stream = nullptr;
+    // Play: the same score already rendered at these settings (RenderCache). the engine mixes this in
+    // and the sequencer runs muted, only reporting notes for display
+    const float* audio = nullptr;
+    int64_t audio_length = 0;
+};
+
+// plays a compiled score from inside the audio callback. time is counted in samples and a cursor walks
+// the sorted events, so a block costs O(events in that block) and nothing at all between events.
+// the renderer asks for the next event inside the block, renders up to its offset, consumes it, applies it
+// if consume() says to, and calls advance() once the whole block is done.
+// seeking, looping and pausing never replay from t=0: they release what is sounding, binary-search the
+// cursor and restart only the notes the score's interval index says are sounding at the new position.
+// tempo and transposition are applied here, as events are reached: score times are scaled on their way
+// to samples and the renderer multiplies note frequencies by pitchRatio(), so one compiled score plays
+// at any speed and key.
+// a ScoreStream plays the same way, taking events as they come in, but it can't seek, loop or restart
+// notes on resume: there is no index over what hasn't been decoded yet
+class MelodySequencer
+{
+public:
+    void prepare(double new_sample_rate)
+    {
+        sample_rate = new_sample_rate;
+        samples_per_score_sec = sample_rate / score_tempo;
+    }
+
+    // the score must outlive playback; it is only read
+    void start(const CompiledScore* new_score, double tempo = 1.0, int transpose = 0)
+    {
+        releaseSounding(0);
+        score = new_score;
+        stream = nullptr;
+        paused = false;
+        setTempo(tempo, transpose);
+        loop_start_sample = loop_end_sample = 0;
+        end_sample = toSamples(score->lengthSecs()) + tailSamples();
+        finished.store(false, std::memory_order_relaxed);
+        jumpTo(0, 0);
+    }
+
+    // the stream must outlive playback
+    void startStream(ScoreStream* new_stream, double tempo = 1.0, int transpose = 0)
+    {
+        releaseSounding(0);
+        score = nullptr;
+        stream = new_stream;
+        paused = false;
+        setTempo(tempo, transpose);
+        loop_start_sample = loop_end_sample = 0;
+        end_sample = 0;
+        position = 0;
+        finished.store(false, std::memory_order_relaxed);
+    }
+
+    void stop()
+    {
+        releaseSounding(0);
+        score = nullptr;
+        stream = nullptr;
+    }
+
+    void seek(double secs)
+    {
+        if (score != nullptr)
+            jumpTo(toSamples(std::max(secs, 0.0)), 0);
+    }
+
+    void setLoop(double start_secs, double end_secs)
+    {
+        loop_start_sample = toSamples(std::max(start_secs, 0.0));
+        loop_end_sample = std::max(toSamples(end_secs), loop_start_sample);
+    }
+
+    void pause()
+    {
+        if (!isPlaying() || paused)
+            return;
+        releaseSounding(0);
+        paused = true;
+    }
+
+    void resume()
+    {
+        if (!isPlaying() || !paused)
+            return;
+        paused = false;
+        if (score != nullptr)
+            jumpTo(position, 0);
+    }
+
+    bool isPlaying() const     { return score != nullptr || stream != nullptr; }
+    bool isPaused() const      { return paused; }
+    double positionSecs() const { return static_cast<double>(position) / samples_per_score_sec; }
+    // frequency multiplier for the playing score's notes
+    float pitchRatio() const    { return pitch_ratio; }
+
+    // next event due before the end of this block, with its offset inside the block, or nullptr.
+    // a loop end inside the block wraps here, so the events after it come back already rebased
+    const ScoreEvent* next(int num_samples, int& offset)
+    {
+        for (;;)
+        {
+            if (pending_read < pending_count)
+            {
+                offset = pending[pending_read].offset;
+                return &pending[pending_read].event;
+            }
+            if (!isPlaying() || paused)
+                return nullptr;
+
+            if (stream != nullptr)
+            {
+                // an event the loader delivered late plays at the start of the block rather than not at all
+                const ScoreEvent* event = stream->events.peek();
+                if (event == nullptr || toSamples(event->time_secs) - position >= num_samples)
+                    return nullptr;
+                offset = static_cast<int>(std::max<int64_t>(toSamples(event->time_secs) - position, 0));
+                return event;
+            }
+
+            const auto& events = score->events();
+            const int64_t at = cursor < events.size() ? toSamples(events[cursor].time_secs) - position : INT64_MAX;
+
+            if (loop_end_sample > loop_start_sample)
+            {
+                const int64_t loop_at = std::max<int64_t>(loop_end_sample - position, 0);
+                if (loop_at < num_samples && at >= loop_at)
+                {
+                    jumpTo(loop_start_sample, static_cast<int>(loop_at));
+                    continue;
+                }
+            }
+
+            if (at >= num_samples)
+                return nullptr;
+
+            offset = static_cast<int>(std::max<int64_t>(at, 0));
+            return &events[cursor];
+        }
+    }
+
+    // false for a note-on that must not be played: one the sequencer couldn't track could never be released
+    bool consume()
+    {
+        if (pending_read < pending_count)
+        {
+            if (++pending_read == pending_count)
+                pending_read = pending_count = 0;
+            return true;
+        }
+
+        ScoreEvent event;
+        if (stream != nullptr)
+        {
+            stream->events.pop(event);
+            end_sample = std::max(end_sample, toSamples(event.time_secs) + tailSamples());
+        }
+        else
+            event = score->events()[cursor++];
+
+        if (event.is_on)
+            return addSounding(event);
+        removeSounding(event.key_code);
+        return true;
+    }
+
+    void advance(int num_samples)
+    {
+        if (!isPlaying() || paused)
+            return;
+
+        position += num_samples;
+        if (stream != nullptr)
+        {
+            if (stream->complete.load(std::memory_order_acquire) && stream->events.peek() == nullptr && position >= end_sample)
+            {
+                stream = nullptr;
+                finished.store(true, std::memory_order_release);
+            }
+            return;
+        }
+
+        const bool looping = loop_end_sample > loop_start_sample;
+        if (!looping && cursor >= score->events().size() && position >= end_sample)
+        {
+            score = nullptr;
+            finished.store(true, std::memory_order_release);
+        }
+    }
+
+    // set by the audio thread when a score ran out; the message thread polls and clears it
+    std::atomic<bool> finished{ false };
+
+private:
+    struct PendingEvent
+    {
+        ScoreEvent event;
+        int offset = 0;
+    };
+
+    void setTempo(double tempo, int transpose)
+    {
+        score_tempo = tempo > 0.0 ? tempo : 1.0;
+        samples_per_score_sec = sample_rate / score_tempo;
+        pitch_ratio = static_cast<float>(std::exp2(transpose / 12.0));
+    }
+
+    // the tail rings out in real time, whatever the tempo
+    int64_t tailSamples() const
+    {
+        return static_cast<int64_t>(std::llround(tail_secs * sample_rate));
+    }
+
+    // score time to samples at the playing tempo
+    int64_t toSamples(double secs) const
+    {
+        return static_cast<int64_t>(std::llround(secs * samples_per_score_sec));
+    }
+
+    // moves score time `sample` to block offset `offset`: offs for what was sounding, then ons for what
+    // sounds at the new position. the cursor and the index query use the same boundary, half a sample
+    // before `sample`, so no note is both restarted here and again by its own on-event
+    void jumpTo(int64_t sample, int offset)
+    {
+        releaseSounding(offset);
+
+        position = sample - offset;
+        const double boundary = (static_cast<double>(sample) - 0.5) / samples_per_score_sec;
+        cursor = score->firstEventAt(boundary);
+        score->forEachSoundingAt(boundary, [this, offset](const ScoreEvent& on) {
+            if (addSounding(on))
+                queue(on, offset);
+        });
+    }
+
+    void releaseSounding(int offset)
+    {
+        for (int i = 0; i < num_sounding; ++i)
+        {
+            queue(sounding[i], offset);
+            sounding_slot[sounding[i].key_code] = 0;
+        }
+        num_sounding = 0;
+    }
+
+    void queue(const ScoreEvent& event, int offset)
+    {
+        if (pending_count < max_pending)
+            pending[pending_count++] = { event, offset };
+    }
+
+    // a key sounds at most once, so every key code has room. a key already sounding stays tracked once;
+    // the engine ignores the second note-on anyway
+    bool addSounding(const ScoreEvent& event)
+    {
+        if (event.key_code < 0 || event.key_code >= max_sounding)
+            return false;
+        if (sounding_slot[event.key_code] == 0)
+        {
+            sounding[num_sounding++] = { event.time_secs, event.key_code, event.frequency, false };
+            sounding_slot[event.key_code] = num_sounding;
+        }
+        return true;
+    }
+
+    void removeSounding(int key_code)
+    {
+        if (key_code < 0 || key_code >= max_sounding || sounding_slot[key_code] == 0)
+            return;
+        const int i = sounding_slot[key_code] - 1;
+        sounding_slot[key_code] = 0;
+        sounding[i] = sounding[--num_sounding];
+        if (i < num_sounding)
+            sounding_slot[sounding[i].key_code] = i + 1;
+    }
+
+    static constexpr double tail_secs = 1.0; // let the last release ring out before reporting the end
+    static constexpr int max_sounding = VoiceAllocator::max_keys;
+    static constexpr int max_pending = max_sounding * 2;
+
+    double sample_rate = 44100.0;
+    double score_tempo = 1.0;
+    double samples_per_score_sec = 44100.0;
+    float pitch_ratio = 1.0f;
+    const CompiledScore* score = nullptr;
+    ScoreStream* stream = nullptr;
+    std::size_t cursor = 0;
+    int64_t position = 0;   // score time in samples at offset 0 of the current block
+    int64_t end_sample = 0;
+    int64_t loop_start_sample = 0;
+    int64_t loop_end_sample = 0;
+    bool paused = false;
+
+    // notes that have started and not ended yet, as ready-made note-offs
+    std::array<ScoreEvent, max_sounding> sounding{};
+    int num_sounding = 0;
+    std::array<int, max_sounding> sounding_slot{}; // key code -> place in sounding plus one, 0 when not sounding
+
+    // offs/ons generated by a stop, seek, pause, resume or loop wrap, handed out before the score's own events
+    std::array<PendingEvent, max_pending> pending{};
+    int pending_count = 0;
+    int pending_read = 0;
+};
@@ -0,0 +1,242 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// thin wrapper over the widest float vector the target was compiled for.
+// everything is a free function on the raw intrinsic type so the kernels read the same on every ISA
+#if defined(__AVX512F__)
+    #include <immintrin.h>
+    #define SYNTH_SIMD_AVX512 1
+#elif defined(__AVX2__)
+    #include <immintrin.h>
+    #define SYNTH_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SYNTH_SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define SYNTH_SIMD_NEON 1
+#endif
+
+namespace simd
+{
+    // voice banks and mix buffers are aligned to this, whatever the lane width
+    static constexpr std::size_t alignment = 64;
+
+#if defined(SYNTH_SIMD_AVX512)
+    using vfloat = __m512;
+    using vuint  = __m512i;
+    static constexpr int width = 16;
+    static constexpr const char* isa_name = "avx512";
+
+    inline vfloat load(const float* p)             { return _mm512_load_ps(p); }
+    inline void   store(float* p, vfloat v)        { _mm512_store_ps(p, v); }
+    inline vfloat broadcast(float x)               { return _mm512_set1_ps(x); }
+    inline vfloat add(vfloat a, vfloat b)          { return _mm512_add_ps(a, b); }
+    inline vfloat sub(vfloat a, vfloat b)          { return _mm512_sub_ps(a, b); }
+    inline vfloat mul(vfloat a, vfloat b)          { return _mm512_mul_ps(a, b); }
+    inline vfloat div(vfloat a, vfloat b)          { return _mm512_div_ps(a, b); }
+    inline vfloat max(vfloat a, vfloat b)          { return _mm512_max_ps(a, b); }
+    inline vfloat bitAnd(vfloat a, vfloat b)       { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_castps_si512(b))); }
+    inline vfloat bitXor(vfloat a, vfloat b)       { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_castps_si512(b))); }
+    inline float  reduceAdd(vfloat a)              { return _mm512_reduce_add_ps(a); }
+
+    inline vuint  load(const uint32_t* p)          { return _mm512_load_si512(p); }
+    inline void   store(uint32_t* p, vuint v)      { _mm512_store_si512(p, v); }
+    inline vuint  broadcast(uint32_t x)            { return _mm512_set1_epi32(static_cast<int>(x)); }
+    inline vuint  add(vuint a, vuint b)            { return _mm512_add_epi32(a, b); }
+    inline vuint  bitXor(vuint a, vuint b)         { return _mm512_xor_si512(a, b); }
+    inline vfloat signedToFloat(vuint a)           { return _mm512_cvtepi32_ps(a); }
+    inline vuint  bitAnd(vuint a, vuint b)         { return _mm512_and_si512(a, b); }
+    template <int bits>
+    inline vuint  shiftRight(vuint a)              { return _mm512_srli_epi32(a, bits); }
+    inline vfloat gather(const float* base, vuint index) { return _mm512_i32gather_ps(index, base, 4); }
+#elif defined(SYNTH_SIMD_AVX2)
+    using vfloat = __m256;
+    using vuint  = __m256i;
+    static constexpr int width = 8;
+    static constexpr const char* isa_name = "avx2";
+
+    inline vfloat load(const float* p)             { return _mm256_load_ps(p); }
+    inline void   store(float* p, vfloat v)        { _mm256_store_ps(p, v); }
+    inline vfloat broadcast(float x)               { return _mm256_set1_ps(x); }
+    inline vfloat add(vfloat a, vfloat b)          { return _mm256_add_ps(a, b); }
+    inline vfloat sub(vfloat a, vfloat b)          { return _mm256_sub_ps(a, b); }
+    inline vfloat mul(vfloat a, vfloat b)          { return _mm256_mul_ps(a, b); }
+    inline vfloat div(vfloat a, vfloat b)          { return _mm256_div_ps(a, b); }
+    inline vfloat max(vfloat a, vfloat b)          { return _mm256_max_ps(a, b); }
+    inline vfloat bitAnd(vfloat a, vfloat b)       { return _mm256_and_ps(a, b); }
+    inline vfloat bitXor(vfloat a, vfloat b)       { return _mm256_xor_ps(a, b); }
+    inline float  reduceAdd(vfloat a)
+    {
+        __m128 v = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 0x55));
+        return _mm_cvtss_f32(v);
+    }
+
+    inline vuint  load(const uint32_t* p)          { return _mm256_load_si256(reinterpret_cast<const __m256i*>(p)); }
+    inline void   store(uint32_t* p, vuint v)      { _mm256_store_si256(reinterpret_cast<__m256i*>(p), v); }
+    inline vuint  broadcast(uint32_t x)            { return _mm256_set1_epi32(static_cast<int>(x)); }
+    inline vuint  add(vuint a, vuint b)            { return _mm256_add_epi32(a, b); }
+    inline vuint  bitXor(vuint a, vuint b)         { return _mm256_xor_si256(a, b); }
+    inline vfloat signedToFloat(vuint a)           { return _mm256_cvtepi32_ps(a); }
+    inline vuint  bitAnd(vuint a, vuint b)         { return _mm256_and_si256(a, b); }
+    template <int bits>
+    inline vuint  shiftRight(vuint a)              { return _mm256_srli_epi32(a, bits); }
+    inline vfloat gather(const float* base, vuint index) { return _mm256_i32gather_ps(base, index, 4); }
+#elif defined(SYNTH_SIMD_SSE2)
+    using vfloat = __m128;
+    using vuint  = __m128i;
+    static constexpr int width = 4;
+    static constexpr const char* isa_name = "sse2";
+
+    inline vfloat load(const float* p)             { return _mm_load_ps(p); }
+    inline void   store(float* p, vfloat v)        { _mm_store_ps(p, v); }
+    inline vfloat broadcast(float x)               { return _mm_set1_ps(x); }
+    inline vfloat add(vfloat a, vfloat b)          { return _mm_add_ps(a, b); }
+    inline vfloat sub(vfloat a, vfloat b)          { return _mm_sub_ps(a, b); }
+    inline vfloat mul(vfloat a, vfloat b)          { return _mm_mul_ps(a, b); }
+    inline vfloat div(vfloat a, vfloat b)          { return _mm_div_ps(a, b); }
+    inline vfloat max(vfloat a, vfloat b)          { return _mm_max_ps(a, b); }
+    inline vfloat bitAnd(vfloat a, vfloat b)       { return _mm_and_ps(a, b); }
+    inline vfloat bitXor(vfloat a, vfloat b)       { return _mm_xor_ps(a, b); }
+    inline float  reduceAdd(vfloat a)
+    {
+        __m128 v = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 0x55));
+        return _mm_cvtss_f32(v);
+    }
+
+    inline vuint  load(const uint32_t* p)          { return _mm_load_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline void   store(uint32_t* p, vuint v)      { _mm_store_si128(reinterpret_cast<__m128i*>(p), v); }
+    inline vuint  broadcast(uint32_t x)            { return _mm_set1_epi32(static_cast<int>(x)); }
+    inline vuint  add(vuint a, vuint b)            { return _mm_add_epi32(a, b); }
+    inline vuint  bitXor(vuint a, vuint b)         { return _mm_xor_si128(a, b); }
+    inline vfloat signedToFloat(vuint a)           { return _mm_cvtepi32_ps(a); }
+    inline vuint  bitAnd(vuint a, vuint b)         { return _mm_and_si128(a, b); }
+    template <int bits>
+    inline vuint  shiftRight(vuint a)              { return _mm_srli_epi32(a, bits); }
+    inline vfloat gather(const float* base, vuint index)
+    {
+        alignas(16) uint32_t i[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(i), index);
+        return _mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]]);
+    }
+#elif defined(SYNTH_SIMD_NEON)
+    using vfloat = float32x4_t;
+    using vuint  = uint32x4_t;
+    static constexpr int width = 4;
+    static constexpr const char* isa_name = "neon";
+
+    inline vfloat load(const float* p)             { return vld1q_f32(p); }
+    inline void   store(float* p, vfloat v)        { vst1q_f32(p, v); }
+    inline vfloat broadcast(float x)               { return vdupq_n_f32(x); }
+    inline vfloat add(vfloat a, vfloat b)          { return vaddq_f32(a, b); }
+    inline vfloat sub(vfloat a, vfloat b)          { return vsubq_f32(a, b); }
+    inline vfloat mul(vfloat a, vfloat b)          { return vmulq_f32(a, b); }
+    inline vfloat div(vfloat a, vfloat b)
+    {
+    #if defined(__aarch64__) || defined(_M_ARM64)
+        return vdivq_f32(a, b);
+    #else
+        float32x4_t r = vrecpeq_f32(b); // estimate plus two Newton steps
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        return vmulq_f32(a, r);
+    #endif
+    }
+    inline vfloat max(vfloat a, vfloat b)          { return vmaxq_f32(a, b); }
+    inline vfloat bitAnd(vfloat a, vfloat b)       { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+    inline vfloat bitXor(vfloat a, vfloat b)       { return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+    inline float  reduceAdd(vfloat a)
+    {
+    #if defined(__aarch64__) || defined(_M_ARM64)
+        return vaddvq_f32(a);
+    #else
+        float32x2_t v = vadd_f32(vget_low_f32(a), vget_high_f32(a));
+        return vget_lane_f32(vpadd_f32(v, v), 0);
+    #endif
+    }
+
+    inline vuint  load(const uint32_t* p)          { return vld1q_u32(p); }
+    inline void   store(uint32_t* p, vuint v)      { vst1q_u32(p, v); }
+    inline vuint  broadcast(uint32_t x)            { return vdupq_n_u32(x); }
+    inline vuint  add(vuint a, vuint b)            { return vaddq_u32(a, b); }
+    inline vuint  bitXor(vuint a, vuint b)         { return veorq_u32(a, b); }
+    inline vfloat signedToFloat(vuint a)           { return vcvtq_f32_s32(vreinterpretq_s32_u32(a)); }
+    inline vuint  bitAnd(vuint a, vuint b)         { return vandq_u32(a, b); }
+    template <int bits>
+    inline vuint  shiftRight(vuint a)              { return vshrq_n_u32(a, bits); }
+    inline vfloat gather(const float* base, vuint index)
+    {
+        float32x4_t v = vdupq_n_f32(base[vgetq_lane_u32(index, 0)]);
+        v = vsetq_lane_f32(base[vgetq_lane_u32(index, 1)], v, 1);
+        v = vsetq_lane_f32(base[vgetq_lane_u32(index, 2)], v, 2);
+        return vsetq_lane_f32(base[vgetq_lane_u32(index, 3)], v, 3);
+    }
+#else
+    using vfloat = float;
+    using vuint  = uint32_t;
+    static constexpr int width = 1;
+    static constexpr const char* isa_name = "scalar";
+
+    inline vfloat load(const float* p)             { return *p; }
+    inline void   store(float* p, vfloat v)        { *p = v; }
+    inline vfloat broadcast(float x)               { return x; }
+    inline vfloat add(vfloat a, vfloat b)          { return a + b; }
+    inline vfloat sub(vfloat a, vfloat b)          { return a - b; }
+    inline vfloat mul(vfloat a, vfloat b)          { return a * b; }
+    inline vfloat div(vfloat a, vfloat b)          { return a / b; }
+    inline vfloat max(vfloat a, vfloat b)          { return a > b ? a : b; }
+    inline vfloat bitAnd(vfloat a, vfloat b)       { return std::bit_cast<float>(std::bit_cast<uint32_t>(a) & std::bit_cast<uint32_t>(b)); }
+    inline vfloat bitXor(vfloat a, vfloat b)       { return std::bit_cast<float>(std::bit_cast<uint32_t>(a) ^ std::bit_cast<uint32_t>(b)); }
+    inline float  reduceAdd(vfloat a)              { return a; }
+
+    inline vuint  load(const uint32_t* p)          { return *p; }
+    inline void   store(uint32_t* p, vuint v)      { *p = v; }
+    inline vuint  broadcast(uint32_t x)            { return x; }
+    inline vuint  add(vuint a, vuint b)            { return a + b; }
+    inline vuint  bitXor(vuint a, vuint b)         { return a ^ b; }
+    inline vfloat signedToFloat(vuint a)           { return static_cast<float>(static_cast<int32_t>(a)); }
+    inline vuint  bitAnd(vuint a, vuint b)         { return a & b; }
+    template <int bits>
+    inline vuint  shiftRight(vuint a)              { return a >> bits; }
+    inline vfloat gather(const float* base, vuint index) { return base[index]; }
+#endif
+
+    inline vfloat zero()                           { return broadcast(0.0f); }
+    // -0.0f is only the sign bit, so these pick apart magnitude and sign without branching
+    inline vfloat abs(vfloat a)                    { return bitXor(a, bitAnd(a, broadcast(-0.0f))); }
+    inline vfloat signOf(vfloat a)                 { return bitAnd(a, broadcast(-0.0f)); }
+
+    // rounds a lane count up so a bank never has a partial vector at the end
+    inline int paddedCount(int count)              { return (count + width - 1) / width * width; }
+
+    // keeps std::vector storage on simd::alignment so the kernels can use aligned loads
+    template <typename T>
+    struct AlignedAllocator
+    {
+        using value_type = T;
+
+        AlignedAllocator() = default;
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U>&) noexcept {}
+
+        T* allocate(std::size_t n)
+        {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{ alignment }));
+        }
+
+        void deallocate(T* p, std::size_t) noexcept
+        {
+            ::operator delete(p, std::align_val_t{ alignment });
+        }
+
+        template <typename U>
+        bool operator==(const AlignedAllocator<U>&) const noexcept { return true; }
+    };
+}
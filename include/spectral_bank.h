@@ -0,0 +1,307 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+#include "additive.h"
+#include "fft.h"
+#include "voice.h"
+#include "voice_slots.h"
+
+// the WaveformType shapes as harmonic series, for OscillatorMode::Spectral: up to 2048 harmonics, as
+// many as fit under Nyquist. the triangle's harmonics are all in sine phase, a quarter cycle off the
+// VoiceBank's, which sounds the same. built once, on first use
+inline const Spectrum& waveformSpectrum(WaveformType type)
+{
+    static const std::array<Spectrum, 4> spectra = [] {
+        constexpr int harmonics = 2048;
+        constexpr double pi = two_pi_d * 0.5;
+        std::array<Spectrum, 4> list;
+        list[static_cast<int>(WaveformType::Sine)].add(1.0f, 1.0f);
+        for (int k = 1; k <= harmonics; ++k)
+        {
+            list[static_cast<int>(WaveformType::Sawtooth)].add(static_cast<float>(k), static_cast<float>(-2.0 / (pi * k)));
+            if (k % 2 == 0)
+                continue;
+            list[static_cast<int>(WaveformType::Square)].add(static_cast<float>(k), static_cast<float>(2.0 / (pi * k)));
+            const double sign = (k / 2) % 2 == 0 ? 1.0 : -1.0;
+            list[static_cast<int>(WaveformType::Triangle)].add(static_cast<float>(k), static_cast<float>(sign * 8.0 / (pi * pi * k * k)));
+        }
+        return list;
+    }();
+    return spectra[static_cast<std::size_t>(type)];
+}
+
+// inverse-FFT oscillator bank: instead of running every partial sample by sample, each hop adds every
+// sounding partial of every voice into one spectrum, as the few bins a windowed sine at its frequency
+// occupies, and a single inverse FFT turns the whole mix into a frame. frames overlap by three
+// quarters and are crossfaded, which also interpolates levels between frames. each hop costs one
+// O(N log N) inverse FFT of the frame size N, the same however many partials there are, plus
+// kernel_bins bins per sounding partial, all spread over the hop's N/4 samples. the cost
+// still grows with the partial count, but by a few bins per partial per hop rather than an oscillator
+// step per partial per sample, so this wins once there are enough partials (bench/spectral_bench.cpp).
+// the window is a 4-term Blackman-Harris, whose spectrum is kernel_half_width bins either side of the
+// partial and more than 90 dB down beyond. frames are centred on hop boundaries and levels are read
+// there: notes start and stop at the next hop, and envelopes are followed in straight lines a hop
+// long. partials too close to Nyquist for their kernel to fit are dropped at note-on.
+// audio thread only
+class SpectralBank
+{
+public:
+    static constexpr int max_partials = 2048;
+    static constexpr int default_frame_size = 512;
+    static constexpr int kernel_half_width = 4;
+    static constexpr int kernel_bins = 2 * kernel_half_width;
+    static constexpr int kernel_oversampling = 256; // table points per bin
+
+    // frame_size is a power of two, 64 or more; hops are a quarter of it
+    void prepare(double new_sample_rate, int polyphony, const AdsrParams& params, int frame_size = default_frame_size)
+    {
+        sample_rate = new_sample_rate;
+        slots.prepare(polyphony, sample_rate, params);
+        fft.prepare(frame_size);
+        waveformSpectrum(WaveformType::Sine); // built now rather than on the first note-on
+        hop = frame_size / 4;
+
+        const auto lanes = static_cast<std::size_t>(slots.size()) * max_partials;
+        first_bin.assign(lanes, 0);
+        weights.assign(lanes * kernel_bins, 0.0f);
+        amplitude.assign(lanes, 0.0f);
+        decay.assign(lanes, 1.0f);
+        phase_re.assign(lanes, 1.0f);
+        phase_im.assign(lanes, 0.0f);
+        step_re.assign(lanes, 1.0f);
+        step_im.assign(lanes, 0.0f);
+        partial_count.assign(static_cast<std::size_t>(slots.size()), 0);
+
+        const auto half = static_cast<std::size_t>(frame_size / 2);
+        spectrum_re.assign(half + 1 + kernel_half_width, 0.0f);
+        spectrum_im.assign(half + 1 + kernel_half_width, 0.0f);
+        frame.assign(static_cast<std::size_t>(frame_size), 0.0f);
+        tail.assign(static_cast<std::size_t>(hop), 0.0f);
+        ready.assign(static_cast<std::size_t>(hop), 0.0f);
+        ready_position = hop;
+        gains.assign(static_cast<std::size_t>(hop), 0.0f);
+        tail_silent = true;
+
+        // the window centred on sample 0 of the frame, and its spectrum (real, as the window is symmetric)
+        // scaled by 1/frame_size so the unnormalized inverse transform gives back window·sine
+        auto window = [frame_size](double n) {
+            const double x = two_pi_d * n / frame_size;
+            return 0.35875 + 0.48829 * std::cos(x) + 0.14128 * std::cos(2.0 * x) + 0.01168 * std::cos(3.0 * x);
+        };
+        kernel.assign(kernel_bins * kernel_oversampling + 2, 0.0f);
+        for (int j = 0; j <= kernel_bins * kernel_oversampling; ++j)
+        {
+            const double offset = static_cast<double>(j) / kernel_oversampling - kernel_half_width;
+            double sum = 0.0;
+            for (int n = -frame_size / 2; n < frame_size / 2; ++n)
+                sum += window(n) * std::cos(two_pi_d * offset * n / frame_size);
+            kernel[static_cast<std::size_t>(j)] = static_cast<float>(sum / frame_size);
+        }
+
+        // the middle half of each frame is used: divided by the window and shaped into a triangle a hop
+        // either side of the centre, so neighbouring frames add up to one
+        rise.resize(static_cast<std::size_t>(hop));
+        fall.resize(static_cast<std::size_t>(hop));
+        for (int i = 0; i < hop; ++i)
+        {
+            rise[static_cast<std::size_t>(i)] = static_cast<float>((static_cast<double>(i) / hop) / window(i - hop));
+            fall[static_cast<std::size_t>(i)] = static_cast<float>((1.0 - static_cast<double>(i) / hop) / window(i));
+        }
+    }
+
+    int frameSize() const { return fft.frameSize(); }
+    int hopSize() const   { return hop; }
+
+    void noteOn(int key, float frequency, const Spectrum& partials)
+    {
+        const int v = slots.noteOn(key);
+        if (v < 0)
+            return;
+
+        // the rotations are worked out once per partial here, as is what a hop does to each. the note is
+        // first heard in the frame centred at the end of the next hop; its phases there are the ones it
+        // would have if it had started right now, so only its level waits for the hop
+        const double bins_per_hz = frameSize() / sample_rate;
+        const int until_centre = (hop - ready_position) + hop;
+        const double highest_bin = frameSize() / 2 - kernel_half_width;
+        const std::size_t base = static_cast<std::size_t>(v) * max_partials;
+        int count = 0;
+        for (int k = 0; k < std::min(partials.size(), max_partials); ++k)
+        {
+            const auto i = static_cast<std::size_t>(k);
+            const double partial_bin = partials.ratio[i] * frequency * bins_per_hz;
+            if (partial_bin >= highest_bin)
+                break;
+            const std::size_t at = base + static_cast<std::size_t>(count++);
+            const double hop_angle = two_pi_d * partial_bin * hop / frameSize();
+
+            // the kernel_bins bins around the partial, read from the table between its points
+            const double whole_bin = std::floor(partial_bin);
+            const double position = (1.0 - (partial_bin - whole_bin)) * kernel_oversampling;
+            const auto whole = static_cast<int>(position);
+            const double frac = position - whole;
+            first_bin[at] = static_cast<int>(whole_bin) - (kernel_half_width - 1);
+            for (int j = 0; j < kernel_bins; ++j)
+            {
+                const auto index = static_cast<std::size_t>(whole + j * kernel_oversampling);
+                weights[at * kernel_bins + static_cast<std::size_t>(j)] = static_cast<float>(kernel[index] + (kernel[index + 1] - kernel[index]) * frac);
+            }
+            // half in the positive frequencies, half mirrored
+            amplitude[at] = static_cast<float>(0.5 * partials.amplitude[i] * std::exp(-partials.decay[i] * until_centre / sample_rate));
+            decay[at] = static_cast<float>(std::exp(-partials.decay[i] * hop / sample_rate));
+            const double phase = two_pi_d * partial_bin * until_centre / frameSize() - 0.25 * two_pi_d; // sine phase at the start
+            phase_re[at] = static_cast<float>(std::cos(phase));
+            phase_im[at] = static_cast<float>(std::sin(phase));
+            step_re[at] = static_cast<float>(std::cos(hop_angle));
+            step_im[at] = static_cast<float>(std::sin(hop_angle));
+        }
+        partial_count[static_cast<std::size_t>(v)] = count;
+    }
+
+    void noteOff(int key) { slots.noteOff(key); }
+
+    // adds the bank's output into mix
+    void render(float* mix, int num_samples)
+    {
+        for (int done = 0; done < num_samples;)
+        {
+            if (ready_position == hop)
+            {
+                if (tail_silent && !anySounding())
+                    return; // nothing left to play, and the hop in hand is silent too
+                synthesizeHop();
+            }
+            const int count = std::min(num_samples - done, hop - ready_position);
+            for (int sample = 0; sample < count; ++sample)
+                mix[done + sample] += ready[static_cast<std::size_t>(ready_position + sample)];
+            ready_position += count;
+            done += count;
+        }
+    }
+
+    // partials still sounding, for load estimates
+    int numPartials() const
+    {
+        int total = 0;
+        for (int v = 0; v < slots.size(); ++v)
+            if (slots.isSounding(v))
+                total += partial_count[static_cast<std::size_t>(v)];
+        return total;
+    }
+
+private:
+    bool anySounding() const
+    {
+        for (int v = 0; v < slots.size(); ++v)
+            if (slots.isSounding(v))
+                return true;
+        return false;
+    }
+
+    // the next frame, centred on the end of the hop it completes
+    void synthesizeHop()
+    {
+        std::fill(spectrum_re.begin(), spectrum_re.end(), 0.0f);
+        std::fill(spectrum_im.begin(), spectrum_im.end(), 0.0f);
+        // bins below 0 land kernel_half_width to the left and are folded back afterwards
+        float* bins_re = spectrum_re.data() + kernel_half_width;
+        float* bins_im = spectrum_im.data() + kernel_half_width;
+
+        bool silent = true;
+        for (int v = 0; v < slots.size(); ++v)
+        {
+            if (!slots.isSounding(v))
+                continue;
+            // the envelope's level at the frame centre; a voice that finishes during the hop is at 0 there
+            const int sounding = slots.envelopeGain(v, gains.data(), hop);
+            if (sounding < hop)
+                continue;
+            silent = false;
+            addPartials(v, gains[static_cast<std::size_t>(hop - 1)], bins_re, bins_im);
+        }
+
+        if (!silent)
+        {
+            // the negative frequencies of partials near 0 Hz, mirrored back onto the positive ones
+            for (int m = 1; m < kernel_half_width; ++m)
+            {
+                bins_re[m] += bins_re[-m];
+                bins_im[m] -= bins_im[-m];
+            }
+            bins_re[0] *= 2.0f;
+            fft.transform(bins_re, bins_im, frame.data());
+        }
+
+        // the rising half of this frame on the falling half of the last one
+        const int size = frameSize();
+        for (int i = 0; i < hop; ++i)
+        {
+            const auto at = static_cast<std::size_t>(i);
+            const float rising = silent ? 0.0f : frame[static_cast<std::size_t>(size - hop + i)] * rise[at];
+            ready[at] = tail[at] + rising;
+            tail[at] = silent ? 0.0f : frame[at] * fall[at];
+        }
+        ready_position = 0;
+        tail_silent = silent;
+    }
+
+    // the O(partials) part of a hop: kernel_bins complex multiply-adds for each partial
+    void addPartials(int v, float level, float* bins_re, float* bins_im)
+    {
+        const std::size_t base = static_cast<std::size_t>(v) * max_partials;
+        const int count = partial_count[static_cast<std::size_t>(v)];
+        for (std::size_t at = base; at < base + static_cast<std::size_t>(count); ++at)
+        {
+            const float a = amplitude[at] * level;
+            const float c_re = a * phase_re[at];
+            const float c_im = a * phase_im[at];
+
+            const float* weight = &weights[at * kernel_bins];
+            float* partial_re = bins_re + first_bin[at];
+            float* partial_im = bins_im + first_bin[at];
+            for (int j = 0; j < kernel_bins; ++j)
+            {
+                partial_re[j] += weight[j] * c_re;
+                partial_im[j] += weight[j] * c_im;
+            }
+
+            // on to the next frame centre; the renormalization keeps rounding from changing the level
+            const float turned_re = phase_re[at] * step_re[at] - phase_im[at] * step_im[at];
+            const float turned_im = phase_re[at] * step_im[at] + phase_im[at] * step_re[at];
+            const float correction = 1.5f - 0.5f * (turned_re * turned_re + turned_im * turned_im);
+            phase_re[at] = turned_re * correction;
+            phase_im[at] = turned_im * correction;
+            amplitude[at] *= decay[at];
+        }
+    }
+
+    double sample_rate = 44100.0;
+    int hop = default_frame_size / 4;
+    VoiceSlots slots;
+    InverseRealFft fft;
+    std::vector<float> kernel;
+    std::vector<float> rise;
+    std::vector<float> fall;
+
+    // max_partials per voice, in voice order
+    std::vector<int> first_bin;   // the lowest bin the partial's kernel touches
+    std::vector<float> weights;   // kernel_bins per partial, fixed by its frequency
+    std::vector<float> amplitude; // half the level, shrinking by decay each hop
+    std::vector<float> decay;
+    std::vector<float> phase_re;  // e^iφ at the next frame centre
+    std::vector<float> phase_im;
+    std::vector<float> step_re;   // what a hop turns the phase by
+    std::vector<float> step_im;
+    std::vector<int> partial_count;
+
+    std::vector<float> spectrum_re; // kernel_half_width bins below 0, then 0..frame_size/2
+    std::vector<float> spectrum_im;
+    std::vector<float> frame;
+    std::vector<float> tail;        // the falling half of the last frame
+    std::vector<float> ready;       // one hop of output
+    int ready_position = 0;
+    std::vector<float> gains;
+    bool tail_silent = true;
+};
@@ -3,22 +3,13 @@
 #include <juce_gui_basics/juce_gui_basics.h>
 #include <fstream>
 #include <string>  
-#include "notes.h"
+#include "melodies.h"
+#include "render_cache.h"
+#include "rt_check.h"
+#include "synth_engine.h"
 
-static constexpr int8_t MAX_NOTES = 10;
-static constexpr float speakers_ch_amplitude = 0.2f;
 void loadSelectedMelody();
 
-struct Note
-{
-    float frequency     = 0.0f;
-    float phase         = 0.0f;
-    float phase_delta   = 0.0f;
-    float amplitude     = 1.0f;
-    bool is_active      = false;
-    int key_code        = -1;
-};
-
 struct VisualNote
 {
     int key_code           = -1;
@@ -35,37 +26,38 @@ struct VisualNote
 class Synth : public juce::AudioAppComponent, public juce::KeyListener, public juce::Timer
 {
 private:
-    enum class WaveformType
-    {
-        Sine,
-        Sawtooth,
-        Square,
-        Triangle
-    };
-    WaveformType waveform = WaveformType::Sine;
-    float sample_rate{};
-    std::array<Note, MAX_NOTES> active_notes{};
+    // the sampled instrument, if the user has one; declared first so it outlives the engine playing it
+    SampleSet samples;
+    // all the sound; this component is only its UI and audio device
+    SynthEngine engine;
+    // message thread only: keys we sent a note-on for and haven't released yet
+    std::vector<int> held_keys;
+    // released keys whose note-off didn't fit in the queue; timerCallback() sends them until it does
+    std::vector<int> pending_note_offs;
     std::map<int, VisualNote> visual_notes;
-    std::map<int, Note> note_map =
-    {
-        // piano
-        {'A', {E3}}, {'W', {F3}}, {'S', {G3b}}, {'E', {G3}},
-        {'D', {A3b}}, {'F', {A3}}, {'T', {B3b}}, {'G', {B3}},
-        {'Y', {C4}}, {'H', {D4b}}, {'U', {D4}}, {'J', {E4b}},
-        {'K', {E4}}, {'O', {F4}}, {'L', {G4b}}, {'P', {G4}},
-        {';', {A4b}}, {'Z', {A4}}, {'X', {B4b}}, {'C', {B4}},
-        {'V', {C5}}, {'B', {D5b}}, {'N', {D5}}, {'M', {E5b}},
-        {'.', {E5}}, {'Z', {F5}}
-    };
+    std::map<int, Note> note_map = keyboardNoteMap();
 
     juce::ComboBox melodySelector;
     juce::TextButton playButton{ "Play Melody" };
+    juce::TextButton pauseButton{ "Pause" };
+    juce::TextButton recordButton{ "Record" };
     juce::Label melodyLabel{ "Melody:", "Select Melody:" };
-
-    std::vector<MelodyNote> melody{};
-    bool is_playing_melody = false;
-    double melody_start_time = 0.0;
-    int next_melody_note_index = 0;
+    juce::Label loadLabel{ "Load:", "load -" };
+
+    int selected_score = 0;     // engine score index, in dropdown order
+    bool melody_paused = false; // message thread's view of the pause button
+    LoadStats logged_load;      // counts already reported, so only new overruns get logged
+    int load_ticks = 0;
+    uint64_t logged_dropped_frames = 0;
+    bool logged_recording_full = false;
+    uint64_t logged_underruns = 0;
+
+    // melodies played once at the current settings replay from memory, see RenderCache
+    static constexpr std::size_t render_cache_bytes = 256u << 20;
+    RenderCache render_cache{ renderCatalogMelody, render_cache_bytes,
+                              juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("synth_render_cache").getFullPathName().toStdString() };
+    std::shared_ptr<const RenderedMelody> playing_render;             // handed to the engine with the last Play
+    std::vector<std::shared_ptr<const RenderedMelody>> retired_renders; // freed once the engine is done with them
 public:
     void log(const std::string& message) const {
         std::cout << message << std::endl;
@@ -73,40 +65,69 @@ public:
 
     Synth()
     {
+        // Populate the dropdown with melody options
+        for (const auto& melody : melodyCatalog())
+        {
+            const int index = engine.addScore(CompiledScore(melody.notes, note_map));
+            melodySelector.addItem(melody.name, index + 1);
+        }
+        melodySelector.setSelectedId(1); // Default to first melody
+
         addAndMakeVisible(melodyLabel);
         addAndMakeVisible(melodySelector);
         addAndMakeVisible(playButton);
-        
-        // Populate the dropdown with melody options
-        melodySelector.addItem("melody_ddlc", 1);
-        melodySelector.addItem("melody1", 2);
-        melodySelector.addItem("melody2", 3);
-        melodySelector.addItem("melody_cinematic", 4);
-        melodySelector.addItem("melody_edm", 5);
-        melodySelector.addItem("melody_jazz", 6);
-        melodySelector.addItem("melody_ambient", 7);
-        melodySelector.addItem("melody_funk", 8);
-        melodySelector.addItem("melody_classical", 9);
-        melodySelector.addItem("melody_minimalist", 10);
-        melodySelector.addItem("melody_epic", 11);
-        melodySelector.addItem("melody_odyssey", 12);
-        melodySelector.addItem("melody_symphony", 13);
-        melodySelector.setSelectedId(1); // Default to first melody
+        addAndMakeVisible(pauseButton);
+        addAndMakeVisible(recordButton);
+        addAndMakeVisible(loadLabel);
+
 
         playButton.onClick = [this] {
             // Load the selected melody first
             loadSelectedMelody();
             
-            // Start playback
-            is_playing_melody = true;
-            melody_start_time = juce::Time::getMillisecondCounter() / 1000.0;
-            next_melody_note_index = 0;
-            log("Melody playback started: " + melodySelector.getText().toStdString());
+            // Start playback; the sequencer itself runs on the audio thread
+            const MelodyEntry& melody = melodyCatalog()[static_cast<std::size_t>(selected_score)];
+            const RenderKey key{ selected_score, engine.waveformType(), engine.oscillatorMode(), engine.sampleRate(), melody.tempo, melody.transpose,
+                                 engine.stealPolicy(), engine.polyphony() };
+            // the cache only knows how to render oscillators
+            auto render = engine.voiceType() == VoiceType::Oscillator ? render_cache.find(key) : nullptr;
+            SequencerCommand play{ SequencerCommand::Type::Play, selected_score, 0.0, 0.0, melody.tempo, melody.transpose };
+            if (render != nullptr)
+            {
+                play.audio = render->samples.data();
+                play.audio_length = static_cast<int64_t>(render->samples.size());
+            }
+            else if (engine.voiceType() == VoiceType::Oscillator)
+            {
+                render_cache.request(key); // live this time, from memory the next
+            }
+
+            if (engine.pushSequencerCommand(play))
+            {
+                if (playing_render != nullptr && playing_render != render)
+                    retired_renders.push_back(std::move(playing_render));
+                playing_render = std::move(render);
+                melody_paused = false;
+                pauseButton.setButtonText("Pause");
+                log("Melody playback started: " + melodySelector.getText().toStdString() + (playing_render != nullptr ? " (pre-rendered)" : ""));
+            }
+        };
+
+        pauseButton.onClick = [this] {
+            const auto type = melody_paused ? SequencerCommand::Type::Resume : SequencerCommand::Type::Pause;
+            if (engine.pushSequencerCommand({ type }))
+            {
+                melody_paused = !melody_paused;
+                pauseButton.setButtonText(melody_paused ? "Resume" : "Pause");
+            }
         };
+
+        recordButton.onClick = [this] { toggleRecording(); };
         
         // Load the default melody
         loadSelectedMelody();
 
+        loadSamples();
         setAudioChannels(0, 2);
         setWantsKeyboardFocus(true);
         addKeyListener(this);
@@ -151,50 +172,56 @@ public:
         log("=== Synth Shutting Down ===");
         removeKeyListener(this);
         shutdownAudio();
+        engine.stopRecording();
     }
 
     void startNote(int key_code)
     {
         // is this note already playing?
-        for (const auto& voice : active_notes)
-            if (voice.is_active && voice.key_code == key_code)
-                return;
+        if (std::find(held_keys.begin(), held_keys.end(), key_code) != held_keys.end())
+            return;
+        // pressed again before its note-off got through: the note never stopped, so it's simply held again
+        if (auto pending = std::find(pending_note_offs.begin(), pending_note_offs.end(), key_code); pending != pending_note_offs.end())
+        {
+            pending_note_offs.erase(pending);
+            held_keys.push_back(key_code);
+            visual_notes[key_code].is_lit = true;
+            repaint();
+            return;
+        }
 
         auto it = note_map.find(key_code);
         if (it != note_map.end())
         {
-            for (auto& voice : active_notes)
+            if (!engine.pushNoteEvent({ NoteEvent::Type::NoteOn, key_code, it->second.frequency, nowNanos(), SynthEngine::keyboard_priority }))
             {
-                if (!voice.is_active && voice.amplitude == 0.0f)
-                {
-                    voice.frequency = it->second.frequency;
-                    voice.phase = 0.0f;
-                    voice.amplitude = 1.0f;
-                    voice.is_active = true;
-                    voice.key_code = key_code;
-
-                    auto& v = visual_notes[key_code];
-                    v.is_lit = true;
-                    v.splash_radius = 0.0f;
-                    v.splash_opacity = 1.0f;
-                    repaint();
-                    return;
-                }
+                log("Note event queue full, dropping note " + std::to_string(key_code));
+                return;
             }
+            held_keys.push_back(key_code);
+
+            auto& v = visual_notes[key_code];
+            v.is_lit = true;
+            v.splash_radius = 0.0f;
+            v.splash_opacity = 1.0f;
+            repaint();
         }
     }
 
     void stopNote(int key_code)
     {
-        for (auto& voice : active_notes)
+        auto it = std::find(held_keys.begin(), held_keys.end(), key_code);
+        if (it != held_keys.end())
         {
-            if (voice.is_active && voice.key_code == key_code)
+            if (!engine.pushNoteEvent({ NoteEvent::Type::NoteOff, key_code, 0.0f, nowNanos() }))
             {
-                voice.is_active = false;
-                visual_notes[key_code].is_lit = false;
-                repaint();
-                return;
+                log("Note event queue full, note " + std::to_string(key_code) + " will be released on the next tick");
+                pending_note_offs.push_back(key_code);
             }
+
+            held_keys.erase(it);
+            visual_notes[key_code].is_lit = false;
+            repaint();
         }
     }
 
@@ -202,72 +229,52 @@ public:
     {
         log("Preparing to play...");
         log("Samples per block set to: " + std::to_string(samplesPerBlockExpected));
-        sample_rate = newSampleRate;
-        log("Sample rate set to: " + std::to_string(sample_rate));
+        engine.prepare(newSampleRate, samplesPerBlockExpected);
+        log("Sample rate set to: " + std::to_string(newSampleRate));
     }
 
     void releaseResources() override {}
 
-    void loadSelectedMelody()
+    static std::string samplesDirectory()
     {
-        int selectedId = melodySelector.getSelectedId();
-        
-        switch (selectedId)
+        return juce::File::getSpecialLocation(juce::File::userMusicDirectory).getChildFile("synth_samples").getFullPathName().toStdString();
+    }
+
+    // the sampler's instrument comes from the user's music folder; setup only, before the audio starts
+    void loadSamples()
+    {
+        const std::string directory = samplesDirectory();
+        std::error_code error;
+        if (!std::filesystem::is_directory(directory, error))
+            return;
+        if (!samples.addDirectory(directory))
         {
-        case 1: // DDLC Theme
-            melody = melody_ddlc;
-            // Apply speed multiplier for DDLC
-            {
-                const double speed_multiplier = 1.5;
-                for (auto& note : melody)
-                {
-                    note.startTimeSecs /= speed_multiplier;
-                    note.durationSecs /= speed_multiplier;
-                }
-            }
-            break;
-        case 2:
-            melody = melody1;
-            break;
-        case 3:
-            melody = melody2;
-            break;
-        case 4:
-            melody = melody_cinematic;
-            break;
-        case 5:
-            melody = melody_edm;
-            break;
-        case 6:
-            melody = melody_jazz;
-            break;
-        case 7:
-            melody = melody_ambient;
-            break;
-        case 8:
-            melody = melody_funk;
-            break;
-        case 9:
-            melody = melody_classical;
-            break;
-        case 10:
-            melody = melody_minimalist;
-            break;
-        case 11:
-            melody = melody_epic;
-            break;
-        case 12:
-            melody = melody_odyssey;
-            break;
-        case 13:
-            melody = melody_symphony;
-            break;
-        default:
-            melody = melody1;
-            break;
+            log("Can't load samples: " + samples.error());
+            return;
         }
-        log("Loaded melody: " + melodySelector.getText().toStdString() + 
-            " (" + std::to_string(melody.size()) + " notes)");
+        engine.setSampleSet(&samples);
+        log("Loaded " + std::to_string(samples.size()) + " samples from " + directory + ", key 7 switches to them");
+    }
+
+    void loadSelectedMelody()
+    {
+        int selectedId = melodySelector.getSelectedId();
+        selected_score = juce::jlimit(0, engine.numScores() - 1, selectedId - 1);
+
+        log("Loaded melody: " + melodySelector.getText().toStdString() +
+            " (" + std::to_string(engine.score(selected_score).numNotes()) + " notes)");
+    }
+
+    // transport for the playing melody, in seconds of score time
+    void seekMelody(double secs)
+    {
+        engine.pushSequencerCommand({ SequencerCommand::Type::Seek, 0, secs });
+    }
+
+    // loops [start_secs, end_secs) until cleared with an empty range
+    void setMelodyLoop(double start_secs, double end_secs)
+    {
+        engine.pushSequencerCommand({ SequencerCommand::Type::SetLoop, 0, start_secs, end_secs });
     }
 
     void resized() override
@@ -280,12 +287,77 @@ public:
         int bottomMargin = 10;
         
         int startX = getWidth() - controlWidth - rightMargin;
-        int startY = getHeight() - (controlHeight * 3 + padding * 2) - bottomMargin;
+        int startY = getHeight() - (controlHeight * 6 + padding * 5) - bottomMargin;
         
         // Stack them vertically
         melodyLabel.setBounds(startX, startY, controlWidth, controlHeight);
         melodySelector.setBounds(startX, startY + controlHeight + 5, controlWidth, controlHeight);
         playButton.setBounds(startX, startY + (controlHeight + 5) * 2, controlWidth, controlHeight);
+        pauseButton.setBounds(startX, startY + (controlHeight + 5) * 3, controlWidth, controlHeight);
+        recordButton.setBounds(startX, startY + (controlHeight + 5) * 4, controlWidth, controlHeight);
+        loadLabel.setBounds(startX, startY + (controlHeight + 5) * 5, controlWidth, controlHeight);
+    }
+
+    // everything the synth plays, keyboard and melody, into a new file in the user's music folder
+    void toggleRecording()
+    {
+        if (engine.isRecording())
+        {
+            engine.stopRecording();
+            recordButton.setButtonText("Record");
+            log("Recording stopped after " + std::to_string(engine.recordedFrames() / static_cast<uint64_t>(engine.sampleRate())) + " s");
+            return;
+        }
+
+        const auto path = juce::File::getSpecialLocation(juce::File::userMusicDirectory)
+                              .getNonexistentChildFile("synth_recording", ".wav")
+                              .getFullPathName()
+                              .toStdString();
+        if (!engine.startRecording(path))
+        {
+            log("Can't record to " + path);
+            return;
+        }
+        logged_dropped_frames = 0;
+        logged_recording_full = false;
+        recordButton.setButtonText("Stop Recording");
+        log("Recording to " + path);
+    }
+
+    // a few times a second is plenty for a number someone has to read
+    void updateLoadDisplay()
+    {
+        if (++load_ticks < 15)
+            return;
+        load_ticks = 0;
+
+        const LoadStats load = engine.loadStats();
+        const auto percent = [](float fraction) { return std::to_string(static_cast<int>(fraction * 100.0f + 0.5f)) + "%"; };
+        loadLabel.setText("load " + percent(load.current) + "  p99 " + percent(load.p99) + "  max " + percent(load.max),
+                          juce::dontSendNotification);
+
+        if (load.overruns > logged_load.overruns || load.xruns > logged_load.xruns)
+            log("Audio callback overran its block " + std::to_string(load.overruns) + " times, " +
+                std::to_string(load.xruns) + " likely xruns (p99 load " + percent(load.p99) + ", max " + percent(load.max) + ")");
+        logged_load = load;
+
+        if (engine.isRecordingFull() && !logged_recording_full)
+        {
+            logged_recording_full = true;
+            engine.stopRecording();
+            recordButton.setButtonText("Record");
+            log("Recording stopped at the 4 GiB .wav limit after " + std::to_string(engine.recordedFrames() / static_cast<uint64_t>(engine.sampleRate())) + " s");
+        }
+
+        const uint64_t dropped = engine.droppedRecordingFrames();
+        if (engine.isRecording() && dropped > logged_dropped_frames)
+            log("Recording fell behind the disk, " + std::to_string(dropped) + " frames dropped so far");
+        logged_dropped_frames = dropped;
+
+        const uint64_t underruns = engine.samplerUnderruns();
+        if (underruns > logged_underruns)
+            log("Sampler underruns: " + std::to_string(underruns) + " (the disk can't keep up)");
+        logged_underruns = underruns;
     }
 
     void timerCallback() override
@@ -309,34 +381,38 @@ public:
             repaint();
         }
 
-        if (is_playing_melody)
-        {
-            const double currentTime = (juce::Time::getMillisecondCounter() / 1000.0) - melody_start_time;
-
-            if (next_melody_note_index < melody.size())
-            {
-                const auto& note = melody[next_melody_note_index];
-                if (currentTime >= note.startTimeSecs)
-                {
-                    startNote(note.keyCode);
-                    next_melody_note_index++;
-                }
-            }
+        // note-offs the queue had no room for earlier
+        std::erase_if(pending_note_offs, [this](int key_code) {
+            return engine.pushNoteEvent({ NoteEvent::Type::NoteOff, key_code, 0.0f, nowNanos() });
+        });
 
-            for (const auto& note : melody)
+        // light up the keys the melody is playing
+        NoteEvent event;
+        while (engine.popPlayedEvent(event))
+        {
+            auto& v = visual_notes[event.key_code];
+            if (event.type == NoteEvent::Type::NoteOn)
             {
-                const double noteEndTime = note.startTimeSecs + note.durationSecs;
-				if (currentTime >= noteEndTime && currentTime < noteEndTime + 0.05) // small buffer to ensure note is stopped
-                {
-                    stopNote(note.keyCode);
-                }
+                v.is_lit = true;
+                v.splash_radius = 0.0f;
+                v.splash_opacity = 1.0f;
             }
-            
-            if (next_melody_note_index >= melody.size() && currentTime > melody.back().startTimeSecs + melody.back().durationSecs + 1.0)
+            else if (std::find(held_keys.begin(), held_keys.end(), event.key_code) == held_keys.end())
             {
-                is_playing_melody = false;
-                log("Melody playback finished.");
+                v.is_lit = false;
             }
+            repaint();
+        }
+
+        updateLoadDisplay();
+
+        std::erase_if(retired_renders, [this](const auto& render) { return !engine.mayReadRenderedAudio(render->samples.data()); });
+
+        if (engine.takeFinished())
+        {
+            melody_paused = false;
+            pauseButton.setButtonText("Pause");
+            log("Melody playback finished.");
         }
     }
 
@@ -375,60 +451,14 @@ public:
 
     void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override
     {
-        auto* leftBuffer  = bufferToFill.buffer->getWritePointer(0, bufferToFill.startSample);
-        auto* rightBuffer = bufferToFill.buffer->getWritePointer(1, bufferToFill.startSample);
-
-        for (int sample = 0; sample < bufferToFill.numSamples; ++sample)
-        {
-            float mix_sample = 0.0f;
-
-            for (auto& voice : active_notes)
-            {
-                if (voice.is_active || voice.amplitude > 0.0f)
-                {
-                    switch (waveform)
-                    {
-                    // 1. sine wave (smooth, classic sound)
-                    case WaveformType::Sine:
-                        mix_sample += voice.amplitude * std::sin(voice.phase);
-                        break;
-                    // 2. sawtooth wave (bright, classic synth sound)
-                    case WaveformType::Sawtooth:
-                        mix_sample += voice.amplitude * ((voice.phase / juce::MathConstants<float>::pi) - 1.0f);
-                        break;
-                    // 3. square wave (buzzy, retro 8-bit sound)
-                    case WaveformType::Square:
-                        mix_sample += voice.amplitude * ((voice.phase < juce::MathConstants<float>::pi) ? 0.5f : -0.5f);
-                        break;
-                    // 4. triangle wave (smooth, rising and falling sound)
-                    case WaveformType::Triangle:
-                        mix_sample += voice.amplitude * (std::abs((voice.phase / juce::MathConstants<float>::pi) - 1.0f) * 2.0f - 1.0f);
-                        break;
-                    default:
-                        mix_sample += voice.amplitude * std::sin(voice.phase); // sine by default
-                        break;
-                    }
-
-                    // advance the phase for this voice (move the wave forward a tiny bit)
-                    voice.phase_delta = (juce::MathConstants<double>::twoPi * voice.frequency / sample_rate);
-                    // ensure that we stay in [0, 2π) bound:
-                    // returned value of std::fmod(x,y) has the same sign as x and is less than y in magnitude
-                    voice.phase = std::fmod(voice.phase + voice.phase_delta, juce::MathConstants<double>::twoPi);
-
-                    if (!voice.is_active)
-                    {
-                        voice.amplitude -= 0.001f; // fade out volume
-                        if (voice.amplitude < 0.0f)
-                        {
-                            voice.amplitude = 0.0f; // ensure it goes quiet
-                        }
-                    }
-                }
-            }
-
-            leftBuffer[sample]  = mix_sample * speakers_ch_amplitude;
-            rightBuffer[sample] = mix_sample * speakers_ch_amplitude;
-        }
+        rtcheck::AudioScope audio_scope;
+        auto* buffer = bufferToFill.buffer;
+        float* channels[2] = {};
+        const int num_channels = juce::jmin(buffer->getNumChannels(), 2);
+        for (int channel = 0; channel < num_channels; ++channel)
+            channels[channel] = buffer->getWritePointer(channel, bufferToFill.startSample);
+
+        engine.process(channels, num_channels, bufferToFill.numSamples);
     }
 
     bool keyPressed(const juce::KeyPress& key, juce::Component* /*originatingComponent*/) override
@@ -439,21 +469,55 @@ public:
         switch (key_code)
         {
         case 49: // 1
-            waveform = WaveformType::Sine;
+            engine.setWaveform(WaveformType::Sine);
             log("Waveform set to Sine");
             return true;
         case 50: // 2
-            waveform = WaveformType::Sawtooth;
+            engine.setWaveform(WaveformType::Sawtooth);
             log("Waveform set to Sawtooth");
             return true;
         case 51: // 3
-            waveform = WaveformType::Square;
+            engine.setWaveform(WaveformType::Square);
             log("Waveform set to Square");
             return true;
         case 52: // 4
-            waveform = WaveformType::Triangle;
+            engine.setWaveform(WaveformType::Triangle);
             log("Waveform set to Triangle");
             return true;
+        case 53: // 5 cycles wavetable -> polyblep -> analytic -> spectral
+            switch (engine.oscillatorMode())
+            {
+            case OscillatorMode::Wavetable:
+                engine.setOscillatorMode(OscillatorMode::PolyBlep);
+                log("Oscillator set to PolyBLEP");
+                break;
+            case OscillatorMode::PolyBlep:
+                engine.setOscillatorMode(OscillatorMode::Analytic);
+                log("Oscillator set to Analytic");
+                break;
+            case OscillatorMode::Analytic:
+                engine.setOscillatorMode(OscillatorMode::Spectral);
+                log("Oscillator set to Spectral (inverse FFT)");
+                break;
+            case OscillatorMode::Spectral:
+                engine.setOscillatorMode(OscillatorMode::Wavetable);
+                log("Oscillator set to Wavetable");
+                break;
+            }
+            return true;
+        case 54: // 6 cycles the voice stealing policy
+            cycleStealPolicy();
+            return true;
+        case 55: // 7 cycles oscillators -> sampler (if samples are loaded) -> additive
+            cycleVoiceType();
+            return true;
+        case 56: // 8 cycles the additive spectrum
+        {
+            const int next = (engine.spectrumIndex() + 1) % static_cast<int>(spectrumPresets().size());
+            engine.setSpectrum(next);
+            log(std::string("Additive spectrum: ") + spectrumPresets()[static_cast<std::size_t>(next)].name);
+            return true;
+        }
         default:
             break;
         }
@@ -462,6 +526,53 @@ public:
         return true;
     }
 
+    void cycleVoiceType()
+    {
+        switch (engine.voiceType())
+        {
+        case VoiceType::Oscillator:
+            if (!samples.empty())
+            {
+                engine.setVoiceType(VoiceType::Sampler);
+                log("Voice type: sampler");
+                break;
+            }
+            log("No samples loaded, put .wav files named by note (e.g. piano_C4.wav) in " + samplesDirectory());
+            [[fallthrough]];
+        case VoiceType::Sampler:
+            engine.setVoiceType(VoiceType::Additive);
+            log(std::string("Voice type: additive, ") + spectrumPresets()[static_cast<std::size_t>(engine.spectrumIndex())].name);
+            break;
+        case VoiceType::Additive:
+            engine.setVoiceType(VoiceType::Oscillator);
+            log("Voice type: oscillator");
+            break;
+        }
+    }
+
+    void cycleStealPolicy()
+    {
+        switch (engine.stealPolicy())
+        {
+        case StealPolicy::Oldest:
+            engine.setStealPolicy(StealPolicy::Quietest);
+            log("Voice stealing: quietest");
+            break;
+        case StealPolicy::Quietest:
+            engine.setStealPolicy(StealPolicy::LowestPriority);
+            log("Voice stealing: lowest priority");
+            break;
+        case StealPolicy::LowestPriority:
+            engine.setStealPolicy(StealPolicy::SameKey);
+            log("Voice stealing: same key");
+            break;
+        case StealPolicy::SameKey:
+            engine.setStealPolicy(StealPolicy::Oldest);
+            log("Voice stealing: oldest");
+            break;
+        }
+    }
+
     bool keyStateChanged(bool isKeyDown, juce::Component* /*originatingComponent*/) override
     {
         if (isKeyDown)
@@ -471,17 +582,16 @@ public:
 
         log("keyStateChanged(up) event received.");
 
-        for (auto& voice : active_notes)
+        // copy: stopNote erases from held_keys
+        const auto keys = held_keys;
+        for (const int key_code : keys)
         {
-            if (voice.is_active)
+            // is the key for this specific voice still being held down?
+            if (!juce::KeyPress::isKeyCurrentlyDown(key_code))
             {
-                // is the key for this specific voice still being held down?
-                if (!juce::KeyPress::isKeyCurrentlyDown(voice.key_code))
-                {
-                    // it's not, the key has been released. fading out
-                    stopNote(voice.key_code);
-                    log("Key OFF: '" + std::to_string(voice.key_code) + "' -> Starting fade out.");
-                }
+                // it's not, the key has been released. fading out
+                stopNote(key_code);
+                log("Key OFF: '" + std::to_string(key_code) + "' -> Starting fade out.");
             }
         }
         return false;
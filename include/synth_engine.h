@@ -0,0 +1,198 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "additive.h"
+#include "event_queue.h"
+#include "load_monitor.h"
+#include "recorder.h"
+#include "render_pool.h"
+#include "sampler.h"
+#include "sequencer.h"
+#include "spectral_bank.h"
+#include "voice_allocator.h"
+
+// what plays the notes
+enum class VoiceType
+{
+    Oscillator, // the VoiceBank, shaped by WaveformType and OscillatorMode; the SpectralBank in OscillatorMode::Spectral,
+                // where notes keep the waveform they started with
+    Sampler,    // the SampleSet given to setSampleSet(), streamed from disk
+    Additive    // the AdditiveBank, sums of sines from spectrumPresets()
+};
+
+// everything that makes sound, with no GUI and no audio device: voices, oscillators, envelopes,
+// the melody sequencer and the output mix. the app, the offline renderer and the benchmarks all
+// drive this one class.
+// threads: scores are added during setup. prepare() and process() run on the audio thread.
+// the push/set functions are called from one other thread (the message thread), and played
+// events and the finished flag go back to that thread
+class SynthEngine
+{
+public:
+    static constexpr int default_polyphony = 64;
+    static constexpr float output_gain = 0.2f;
+    // live playing outranks the melody when voices have to be stolen
+    static constexpr int keyboard_priority = 1;
+    static constexpr int melody_priority = 0;
+    // below this many sounding voices a block is rendered on the audio thread alone; handing out
+    // the work and waiting for it would cost more than the voices themselves
+    static constexpr int default_parallel_threshold = 64;
+
+    explicit SynthEngine(int polyphony = default_polyphony);
+
+    // setup, before audio starts; returns the index Play commands refer to
+    int addScore(CompiledScore score);
+    int numScores() const                        { return static_cast<int>(scores.size()); }
+    const CompiledScore& score(int index) const  { return scores[static_cast<std::size_t>(index)]; }
+
+    // setup: the sampled instrument VoiceType::Sampler plays; must outlive the engine. takes effect at the
+    // next prepare()
+    void setSampleSet(const SampleSet* samples) { sampler.setSampleSet(samples); }
+
+    // setup: renders voices on this many extra threads plus the audio thread, 0 for none; capped at
+    // one per spare core. takes effect at the next prepare()
+    void setRenderThreads(int num_workers);
+    int renderThreads() const { return pool != nullptr ? pool->size() - 1 : 0; }
+    void setParallelThreshold(int voices) { parallel_threshold = voices; }
+
+    // audio thread
+    void prepare(double new_sample_rate, int max_block_size);
+    // renders num_samples into every channel, replacing what was there
+    void process(float* const* channels, int num_channels, int num_samples);
+
+    // any thread: the rate of the last prepare()
+    double sampleRate() const { return prepared_sample_rate.load(std::memory_order_relaxed); }
+    int maxBlockSize() const  { return max_block; }
+    // any thread: fixed at construction
+    int polyphony() const     { return voices.size(); }
+    bool isMelodyPlaying() const { return sequencer.isPlaying(); }
+
+    // message thread -> audio thread; false when the queue is full
+    bool pushNoteEvent(const NoteEvent& event)                { return note_events.push(event); }
+    bool pushSequencerCommand(const SequencerCommand& command) { return sequencer_commands.push(command); }
+
+    // picked up at the start of the next block
+    void setWaveform(WaveformType type)        { waveform.store(type, std::memory_order_relaxed); }
+    void setOscillatorMode(OscillatorMode mode) { oscillator_mode.store(mode, std::memory_order_relaxed); }
+    void setStealPolicy(StealPolicy policy)    { steal_policy.store(policy, std::memory_order_relaxed); }
+    // new notes only; notes already sounding finish on the voice type they started with
+    void setVoiceType(VoiceType type)          { voice_type.store(type, std::memory_order_relaxed); }
+    // index into spectrumPresets() for VoiceType::Additive; new notes only, like the voice type
+    void setSpectrum(int index)                { spectrum.store(index, std::memory_order_relaxed); }
+    WaveformType waveformType() const          { return waveform.load(std::memory_order_relaxed); }
+    OscillatorMode oscillatorMode() const      { return oscillator_mode.load(std::memory_order_relaxed); }
+    StealPolicy stealPolicy() const            { return steal_policy.load(std::memory_order_relaxed); }
+    VoiceType voiceType() const                { return voice_type.load(std::memory_order_relaxed); }
+    int spectrumIndex() const                  { return spectrum.load(std::memory_order_relaxed); }
+
+    // audio thread -> message thread: melody notes as they are played, for display
+    bool popPlayedEvent(NoteEvent& event) { return played_events.pop(event); }
+    // true once each time a melody runs out
+    bool takeFinished()                   { return sequencer.finished.exchange(false); }
+
+    // message thread: records everything process() outputs to a .wav file at the prepared sample rate
+    // until stopRecording(); the audio thread only copies blocks into memory
+    bool startRecording(const std::string& path, int num_channels = 2) { return recorder.start(path, sampleRate(), num_channels); }
+    void stopRecording()                    { recorder.stop(); }
+    bool isRecording() const                { return recorder.isRecording(); }
+    uint64_t recordedFrames() const         { return recorder.recordedFrames(); }
+    // frames that never made it to the file because the disk fell behind
+    uint64_t droppedRecordingFrames() const { return recorder.droppedFrames(); }
+    // the recording stopped because the file reached the 4 GiB .wav limit
+    bool isRecordingFull() const            { return recorder.isFull(); }
+
+    // message thread: whether the audio thread may still read this pre-rendered audio (SequencerCommand::audio),
+    // now or through a command it hasn't applied yet. the buffer has to stay alive until this is false
+    bool mayReadRenderedAudio(const float* audio) const
+    {
+        return !sequencer_commands.empty() || rendered_in_use.load(std::memory_order_acquire) == audio;
+    }
+
+    // offline rendering, on the thread that calls process(): true once the sampler has streamed everything
+    // the next num_samples need. waiting for it makes a render independent of disk speed
+    bool isSamplerStreamedAhead(int num_samples) const { return sampler.isStreamedAhead(num_samples); }
+    // any thread: times a sampler voice went silent because the disk fell behind
+    uint64_t samplerUnderruns() const { return sampler.underruns(); }
+
+    // any thread: how much of each block's period process() used, never blocks the audio thread
+    LoadStats loadStats() const { return load.stats(); }
+    void resetLoadStats()       { load.reset(); }
+
+private:
+    void applyNoteEvent(const NoteEvent& event);
+    void applyScoreEvent(const ScoreEvent& event);
+    void applySequencerCommands();
+    void noteOn(int key, float frequency, int priority);
+    void noteOff(int key);
+    void stopMelody();
+    void setRenderedAudio(const float* audio, int64_t length);
+    bool handOverToLive();
+    void mixRenderedAudio(float* mix, int num_samples);
+    void renderVoices(float* mix, int num_samples);
+    template <WaveformType W>
+    void renderWaveform(float* mix, int num_samples);
+    template <typename Oscillator>
+    void renderBank(float* mix, int num_samples, const Oscillator& oscillator);
+
+    double sample_rate = 44100.0; // audio thread
+    int max_block = 0;
+    std::atomic<double> prepared_sample_rate{ 44100.0 }; // sample_rate, published for the other threads
+
+    std::atomic<WaveformType> waveform{ WaveformType::Sine };
+    std::atomic<OscillatorMode> oscillator_mode{ OscillatorMode::Wavetable };
+    std::atomic<StealPolicy> steal_policy{ StealPolicy::Oldest };
+    std::atomic<VoiceType> voice_type{ VoiceType::Oscillator };
+    std::atomic<int> spectrum{ 0 };
+
+    // audio thread only
+    VoiceBank bank;
+    VoiceAllocator voices{ bank };
+    Sampler sampler;
+    AdditiveBank additive;
+    SpectralBank spectral;
+    Wavetables wavetables;
+    BlockClock block_clock;
+    MelodySequencer sequencer;
+    std::unique_ptr<RenderPool> pool;
+    std::vector<std::vector<float, simd::AlignedAllocator<float>>> scratch; // one block per share of the pool
+    int parallel_threshold = default_parallel_threshold;
+    // a pre-rendered melody being mixed in; the sequencer then plays muted
+    const float* rendered_audio = nullptr;
+    int64_t rendered_length = 0;
+    int64_t rendered_position = 0;
+    bool melody_muted = false;
+    WaveformType block_waveform = WaveformType::Sine;
+    OscillatorMode block_oscillator_mode = OscillatorMode::Wavetable;
+    VoiceType block_voice_type = VoiceType::Oscillator;
+
+    // compiled once during setup, read-only afterwards, so the audio thread can play them by pointer
+    std::vector<CompiledScore> scores;
+
+    SpscQueue<NoteEvent, 256> note_events;
+    SpscQueue<SequencerCommand, 16> sequencer_commands;
+    SpscQueue<NoteEvent, 256> played_events;
+    LoadMonitor load;
+    Recorder recorder;
+    std::atomic<const float*> rendered_in_use{ nullptr };
+};
+
+// bump whenever a change makes the engine sound different for the same input, so renders cached by an
+// older build (RenderCache) are never played again
+constexpr uint32_t synth_engine_version = 1;
+
+struct OfflineRenderSettings
+{
+    WaveformType waveform = WaveformType::Sine;
+    OscillatorMode oscillator_mode = OscillatorMode::Wavetable;
+    double sample_rate = 48000.0;
+    double tempo = 1.0;
+    int transpose = 0;
+    StealPolicy steal_policy = StealPolicy::Oldest;
+    int polyphony = SynthEngine::default_polyphony;
+    int block_size = 512;
+};
+
+// plays a score start to finish, release tail included, through a fresh engine as fast as it goes.
+// returns one channel; process() writes the same to all of them
+std::vector<float> renderOffline(const CompiledScore& score, const OfflineRenderSettings& settings);
@@ -0,0 +1,87 @@
+#pragma once
+#include <cmath>
+
+static constexpr float  pi_f     = 3.14159265358979323846f;
+static constexpr double two_pi_d = 6.28318530717958647692;
+
+enum class WaveformType
+{
+    Sine,
+    Sawtooth,
+    Square,
+    Triangle
+};
+
+struct Note
+{
+    float frequency     = 0.0f;
+    float phase         = 0.0f;
+    float phase_delta   = 0.0f;
+    float amplitude     = 1.0f;
+    bool is_active      = false;
+    int key_code        = -1;
+};
+
+// one sample of the (naive) waveform at the given phase in [0, 2π)
+template <WaveformType W>
+inline float waveSample(float phase)
+{
+    if constexpr (W == WaveformType::Sine)
+        return std::sin(phase);                                        // smooth, classic sound
+    else if constexpr (W == WaveformType::Sawtooth)
+        return (phase / pi_f) - 1.0f;                                  // bright, classic synth sound
+    else if constexpr (W == WaveformType::Square)
+        return (phase < pi_f) ? 0.5f : -0.5f;                          // buzzy, retro 8-bit sound
+    else
+        return std::abs((phase / pi_f) - 1.0f) * 2.0f - 1.0f;          // smooth, rising and falling sound
+}
+
+// renders one voice over the whole block and adds it into mix.
+// everything that doesn't change within a block (waveform, phase delta, held/released state)
+// is resolved once here instead of once per sample
+template <WaveformType W>
+inline void renderVoice(Note& voice, float* mix, int num_samples, double sample_rate)
+{
+    voice.phase_delta = static_cast<float>(two_pi_d * voice.frequency / sample_rate);
+
+    const float phase_delta = voice.phase_delta;
+    float phase = voice.phase;
+    float amplitude = voice.amplitude;
+
+    if (voice.is_active)
+    {
+        for (int sample = 0; sample < num_samples; ++sample)
+        {
+            mix[sample] += amplitude * waveSample<W>(phase);
+            // std::fmod keeps us in [0, 2π)
+            phase = static_cast<float>(std::fmod(phase + phase_delta, two_pi_d));
+        }
+    }
+    else
+    {
+        for (int sample = 0; sample < num_samples; ++sample)
+        {
+            mix[sample] += amplitude * waveSample<W>(phase);
+            phase = static_cast<float>(std::fmod(phase + phase_delta, two_pi_d));
+
+            amplitude -= 0.001f; // fade out volume
+            if (amplitude <= 0.0f)
+            {
+                amplitude = 0.0f; // quiet now, nothing left to add for the rest of the block
+                break;
+            }
+        }
+    }
+
+    voice.phase = phase;
+    voice.amplitude = amplitude;
+}
+
+// renders every sounding voice with the waveform fixed at compile time
+template <WaveformType W, typename Voices>
+inline void renderVoices(Voices& voices, float* mix, int num_samples, double sample_rate)
+{
+    for (auto& voice : voices)
+        if (voice.is_active || voice.amplitude > 0.0f)
+            renderVoice<W>(voice, mix, num_samples, sample_rate);
+}
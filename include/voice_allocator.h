@@ -0,0 +1,237 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "voice_bank.h"
+
+// what gives way when every voice is busy
+enum class StealPolicy
+{
+    Oldest,         // the voice that started first
+    Quietest,       // the voice with the lowest amplitude right now
+    LowestPriority, // the voice started with the lowest priority, oldest first among equals
+    SameKey         // the voice still ringing on the same key, otherwise the oldest
+};
+
+// hands out VoiceBank lanes in O(1): free voices sit on a list, a key -> voice table answers
+// "is this key sounding" without scanning, and voices are kept in start order so the oldest is
+// always at the front. released voices are offered up before held ones whatever the policy.
+// a stolen voice doesn't cut off: its sound moves to one of a few spare fade-tail lanes that ramp
+// down over a couple of milliseconds while the new note starts in the voice straight away.
+// audio thread only
+class VoiceAllocator
+{
+public:
+    static constexpr int max_keys = 256; // key codes are ASCII for now
+
+    explicit VoiceAllocator(VoiceBank& voice_bank) : bank(voice_bank) {}
+
+    // resizes the bank to polyphony playable voices plus the fade-tail lanes; drops everything sounding
+    void resize(int new_polyphony, int fade_tails = 8)
+    {
+        polyphony = new_polyphony;
+        const int lanes = polyphony + fade_tails;
+        bank.resize(lanes);
+
+        prev.assign(lanes, -1);
+        next.assign(lanes, -1);
+        owner.assign(lanes, nullptr);
+        priority.assign(lanes, 0);
+        key_voice.fill(-1);
+        free_voices = held = releasing = free_tails = fading_tails = {};
+
+        for (int v = 0; v < polyphony; ++v)
+            pushBack(free_voices, v);
+        for (int v = polyphony; v < lanes; ++v)
+            pushBack(free_tails, v);
+    }
+
+    void setSampleRate(double sample_rate)
+    {
+        bank.setSampleRate(sample_rate);
+    }
+
+    void setStealPolicy(StealPolicy new_policy) { policy = new_policy; }
+    StealPolicy stealPolicy() const             { return policy; }
+    int size() const                            { return polyphony; }
+
+    // voice held by this key, or -1
+    int heldVoice(int key) const
+    {
+        const int v = voiceFor(key);
+        return v >= 0 && bank.isActive(v) ? v : -1;
+    }
+
+    // starts a note unless the key is already held; returns the voice, or -1 for an unmapped key, zero
+    // polyphony, or (under LowestPriority) every voice held by a note that outranks this one
+    int noteOn(int key, float frequency, int note_priority = 0)
+    {
+        if (key < 0 || key >= max_keys || heldVoice(key) >= 0)
+            return -1;
+
+        const int v = free_voices.head >= 0 ? free_voices.head : chooseVictim(key, note_priority);
+        if (v < 0)
+            return -1;
+        if (bank.isSounding(v))
+            fadeOut(v);
+
+        unlink(v);
+        pushBack(held, v);
+        forget(v);
+        key_voice[key] = v;
+        priority[v] = note_priority;
+        bank.start(v, key, frequency);
+        return v;
+    }
+
+    void noteOff(int key)
+    {
+        const int v = heldVoice(key);
+        if (v < 0)
+            return;
+
+        bank.release(v);
+        unlink(v);
+        pushBack(releasing, v);
+    }
+
+    // returns voices whose release, and tails whose fade, ran down to silence; call after rendering.
+    // only walks voices that are fading
+    void reclaim()
+    {
+        reclaimList(releasing, free_voices);
+        reclaimList(fading_tails, free_tails);
+    }
+
+private:
+    struct VoiceList
+    {
+        int head = -1;
+        int tail = -1;
+    };
+
+    int voiceFor(int key) const
+    {
+        return key >= 0 && key < max_keys ? key_voice[key] : -1;
+    }
+
+    // releasing voices go first (oldest release first), then held voices by policy; -1 with no voices at all.
+    // LowestPriority never lets a note take a held voice from one of higher priority
+    int chooseVictim(int key, int note_priority) const
+    {
+        if (releasing.head < 0 && held.head < 0)
+            return -1;
+        if (policy == StealPolicy::SameKey && voiceFor(key) >= 0)
+            return voiceFor(key);
+        if (releasing.head >= 0)
+            return policy == StealPolicy::Quietest ? quietestIn(releasing) : releasing.head;
+
+        switch (policy)
+        {
+        case StealPolicy::Quietest:       return quietestIn(held);
+        case StealPolicy::LowestPriority:
+        {
+            const int v = lowestPriorityIn(held);
+            return v >= 0 && priority[v] <= note_priority ? v : -1;
+        }
+        default:                          return held.head;
+        }
+    }
+
+    // the two scans below only run when every voice is busy
+    int quietestIn(const VoiceList& list) const
+    {
+        if (list.head < 0)
+            return -1;
+        int best = list.head;
+        for (int v = next[best]; v >= 0; v = next[v])
+            if (bank.level(v) < bank.level(best))
+                best = v;
+        return best;
+    }
+
+    int lowestPriorityIn(const VoiceList& list) const
+    {
+        if (list.head < 0)
+            return -1;
+        int best = list.head;
+        for (int v = next[best]; v >= 0; v = next[v])
+            if (priority[v] < priority[best])
+                best = v;
+        return best;
+    }
+
+    // moves what the voice is playing into a fade-tail lane, reusing the oldest tail if none is free
+    void fadeOut(int v)
+    {
+        const int t = free_tails.head >= 0 ? free_tails.head : fading_tails.head;
+        if (t < 0)
+            return;
+
+        bank.copyVoice(v, t);
+        bank.fadeOut(t);
+        unlink(t);
+        pushBack(fading_tails, t);
+    }
+
+    void reclaimList(VoiceList& list, VoiceList& to)
+    {
+        for (int v = list.head; v >= 0;)
+        {
+            const int after = next[v];
+            if (!bank.isSounding(v))
+            {
+                bank.retire(v);
+                unlink(v);
+                forget(v);
+                pushBack(to, v);
+            }
+            v = after;
+        }
+    }
+
+    // clears the key entry if it still points at this voice
+    void forget(int v)
+    {
+        const int key = bank.keyCode(v);
+        if (voiceFor(key) == v)
+            key_voice[key] = -1;
+    }
+
+    // every lane is on exactly one list; owner remembers which so unlink() needs no argument
+    void pushBack(VoiceList& list, int v)
+    {
+        prev[v] = list.tail;
+        next[v] = -1;
+        if (list.tail >= 0)
+            next[list.tail] = v;
+        else
+            list.head = v;
+        list.tail = v;
+        owner[v] = &list;
+    }
+
+    void unlink(int v)
+    {
+        VoiceList& list = *owner[v];
+        if (prev[v] >= 0) next[prev[v]] = next[v]; else list.head = next[v];
+        if (next[v] >= 0) prev[next[v]] = prev[v]; else list.tail = prev[v];
+        prev[v] = next[v] = -1;
+    }
+
+    VoiceBank& bank;
+    StealPolicy policy = StealPolicy::Oldest;
+    int polyphony = 0;
+
+    std::vector<int> prev;
+    std::vector<int> next;
+    std::vector<VoiceList*> owner;
+    std::vector<int> priority;
+    std::array<int, max_keys> key_voice{};
+
+    VoiceList free_voices;
+    VoiceList held;
+    VoiceList releasing;
+    VoiceList free_tails;
+    VoiceList fading_tails;
+};
@@ -0,0 +1,327 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "envelope.h"
+#include "oscillator.h"
+#include "polyblep.h"
+#include "wavetable.h"
+
+// structure-of-arrays voice storage: every per-voice field lives in its own aligned array,
+// padded to a whole number of SIMD vectors, so one instruction advances simd::width voices.
+// a dense list of the sounding lanes, changed only at start and retire, is all render() looks at,
+// so idle voices cost nothing however large the bank is
+class VoiceBank
+{
+public:
+    template <typename T>
+    using lane_vector = std::vector<T, simd::AlignedAllocator<T>>;
+
+    explicit VoiceBank(int max_voices = 0)
+    {
+        resize(max_voices);
+        envelope.compute(adsr, sample_rate);
+    }
+
+    // drops all voices; capacity is rounded up to the SIMD width, the padding lanes stay silent
+    void resize(int max_voices)
+    {
+        num_voices = max_voices;
+        const auto lanes = static_cast<std::size_t>(simd::paddedCount(max_voices));
+
+        frequency.assign(lanes, 0.0f);
+        phase.assign(lanes, 0u);
+        phase_inc.assign(lanes, 0u);
+        table_offset.assign(lanes, 0u);
+        env_level.assign(lanes, 0.0f);
+        env_coef.assign(lanes, 0.0f);
+        env_offset.assign(lanes, 0.0f);
+        env_remaining.assign(lanes, EnvelopeSegment::endless);
+        env_stage.assign(lanes, EnvelopeStage::Idle);
+        is_active.assign(lanes, 0);
+        key_code.assign(lanes, -1);
+        sounding.assign(lanes, -1);
+        sounding_slot.assign(lanes, -1);
+        num_sounding = 0;
+    }
+
+    // phase increments and envelope times depend on the rate, so every voice is re-tuned here
+    void setSampleRate(double new_sample_rate)
+    {
+        sample_rate = new_sample_rate;
+        envelope.compute(adsr, sample_rate);
+        for (int v = 0; v < num_voices; ++v)
+            phase_inc[v] = phaseIncrement(frequency[v], sample_rate);
+    }
+
+    // voices pick the new shape up at their next stage change
+    void setEnvelope(const AdsrParams& params)
+    {
+        adsr = params;
+        envelope.compute(adsr, sample_rate);
+    }
+
+    const AdsrParams& envelopeParams() const { return adsr; }
+
+    int size() const        { return num_voices; }
+    int capacity() const    { return static_cast<int>(env_level.size()); }
+    int numSounding() const { return num_sounding; }
+
+    bool isActive(int v) const   { return is_active[v] != 0; }
+    bool isSounding(int v) const { return env_stage[v] != EnvelopeStage::Idle; }
+    int  keyCode(int v) const    { return key_code[v]; }
+    float level(int v) const     { return env_level[v]; }
+    EnvelopeStage stage(int v) const { return env_stage[v]; }
+
+    // samples until the voice's current envelope segment ends, EnvelopeSegment::endless while it holds
+    int samplesToSegmentEnd(int v) const { return env_remaining[v]; }
+
+    // a stolen voice's old sound has been moved out by the allocator, so every note attacks from silence
+    void start(int v, int key, float freq)
+    {
+        frequency[v] = freq;
+        phase[v] = 0u;
+        phase_inc[v] = phaseIncrement(freq, sample_rate);
+        table_offset[v] = Wavetables::tableOffset(freq);
+        is_active[v] = 1;
+        key_code[v] = key;
+        env_level[v] = 0.0f;
+        enterStage(v, EnvelopeStage::Attack);
+        enlist(v);
+    }
+
+    // the voice keeps sounding through its release
+    void release(int v)
+    {
+        is_active[v] = 0;
+        enterStage(v, EnvelopeStage::Release);
+    }
+
+    // a release of a couple of milliseconds, for voices that are being stolen
+    void fadeOut(int v)
+    {
+        is_active[v] = 0;
+        env_stage[v] = EnvelopeStage::Release;
+        enterSegment(v, envelope.fade_out);
+        if (env_remaining[v] == 0)
+            enterStage(v, EnvelopeStage::Idle);
+    }
+
+    // continues another voice's sound, mid-cycle, in this lane
+    void copyVoice(int from, int to)
+    {
+        frequency[to] = frequency[from];
+        phase[to] = phase[from];
+        phase_inc[to] = phase_inc[from];
+        table_offset[to] = table_offset[from];
+        env_level[to] = env_level[from];
+        env_coef[to] = env_coef[from];
+        env_offset[to] = env_offset[from];
+        env_remaining[to] = env_remaining[from];
+        env_stage[to] = env_stage[from];
+        is_active[to] = is_active[from];
+        key_code[to] = key_code[from];
+        enlist(to);
+    }
+
+    // takes a voice that has gone silent off the render list
+    void retire(int v)
+    {
+        const int slot = sounding_slot[v];
+        if (slot < 0)
+            return;
+
+        const int last = sounding[--num_sounding];
+        sounding[slot] = last;
+        sounding_slot[last] = slot;
+        sounding_slot[v] = -1;
+        is_active[v] = 0;
+        enterStage(v, EnvelopeStage::Idle);
+    }
+
+    // adds every sounding voice into mix, simd::width voices at a time
+    template <typename Oscillator>
+    void render(float* mix, int num_samples, const Oscillator& oscillator)
+    {
+        renderGroups(0, numGroups(), mix, num_samples, oscillator);
+    }
+
+    // sounding voices in batches of simd::width; disjoint ranges of groups touch disjoint lanes,
+    // so they can be rendered on different threads
+    int numGroups() const { return (num_sounding + simd::width - 1) / simd::width; }
+
+    template <typename Oscillator>
+    void renderGroups(int begin, int end, float* mix, int num_samples, const Oscillator& oscillator)
+    {
+        for (int group = begin; group < end; ++group)
+        {
+            const int first = group * simd::width;
+            renderGroup(&sounding[first], std::min(simd::width, num_sounding - first), mix, num_samples, oscillator);
+        }
+    }
+
+private:
+    void enlist(int v)
+    {
+        if (sounding_slot[v] >= 0)
+            return;
+        sounding_slot[v] = num_sounding;
+        sounding[num_sounding++] = v;
+    }
+
+    void enterSegment(int v, const EnvelopeSegment& segment)
+    {
+        env_coef[v] = segment.coef;
+        env_offset[v] = segment.offset;
+        env_remaining[v] = segment.samplesFrom(env_level[v]);
+    }
+
+    // sets up a stage from the voice's current level, falling through stages that are already over
+    void enterStage(int v, EnvelopeStage stage)
+    {
+        for (;;)
+        {
+            env_stage[v] = stage;
+            switch (stage)
+            {
+            case EnvelopeStage::Attack:
+                enterSegment(v, envelope.attack);
+                if (env_remaining[v] > 0)
+                    return;
+                env_level[v] = 1.0f;
+                stage = EnvelopeStage::Decay;
+                break;
+            case EnvelopeStage::Decay:
+                enterSegment(v, envelope.decay);
+                if (env_remaining[v] > 0)
+                    return;
+                stage = EnvelopeStage::Sustain;
+                break;
+            case EnvelopeStage::Sustain:
+                env_level[v] = static_cast<float>(envelope.sustain.goal);
+                env_coef[v] = 1.0f;
+                env_offset[v] = 0.0f;
+                env_remaining[v] = EnvelopeSegment::endless;
+                return;
+            case EnvelopeStage::Release:
+                enterSegment(v, envelope.release);
+                if (env_remaining[v] > 0)
+                    return;
+                stage = EnvelopeStage::Idle;
+                break;
+            case EnvelopeStage::Idle:
+                env_level[v] = 0.0f;
+                env_coef[v] = 0.0f;
+                env_offset[v] = 0.0f;
+                env_remaining[v] = EnvelopeSegment::endless;
+                return;
+            }
+        }
+    }
+
+    // the segment that ran out lands exactly on its goal, whatever float rounding did on the way
+    void finishSegment(int v)
+    {
+        switch (env_stage[v])
+        {
+        case EnvelopeStage::Attack:
+            env_level[v] = 1.0f;
+            enterStage(v, EnvelopeStage::Decay);
+            break;
+        case EnvelopeStage::Decay:
+            enterStage(v, EnvelopeStage::Sustain);
+            break;
+        default:
+            enterStage(v, EnvelopeStage::Idle);
+            break;
+        }
+    }
+
+    // the listed lanes are scattered over the bank: their state is packed into one vector per field
+    // for the block and written back after it. unused lanes of the last group are silent zeros.
+    // the block is split where the first envelope segment of the group ends, so the inner loop is
+    // one multiply-add per sample for the envelope and never tests a lane
+    template <typename Oscillator>
+    void renderGroup(const int* lanes, int count, float* mix, int num_samples, const Oscillator& oscillator)
+    {
+        alignas(64) uint32_t packed_phase[simd::width] = {};
+        alignas(64) uint32_t packed_inc[simd::width] = {};
+        alignas(64) uint32_t packed_table[simd::width] = {};
+        alignas(64) float packed_level[simd::width] = {};
+        alignas(64) float packed_coef[simd::width] = {};
+        alignas(64) float packed_offset[simd::width] = {};
+        for (int i = 0; i < count; ++i)
+        {
+            const int v = lanes[i];
+            packed_phase[i] = phase[v];
+            packed_inc[i] = phase_inc[v];
+            packed_table[i] = table_offset[v];
+            packed_level[i] = env_level[v];
+            packed_coef[i] = env_coef[v];
+            packed_offset[i] = env_offset[v];
+        }
+
+        using namespace simd;
+        vuint ph = load(packed_phase);
+        const vuint inc = load(packed_inc);
+        const vuint table = load(packed_table);
+
+        for (int done = 0; done < num_samples;)
+        {
+            int run = num_samples - done;
+            for (int i = 0; i < count; ++i)
+                run = std::min(run, env_remaining[lanes[i]]);
+
+            vfloat level = load(packed_level);
+            const vfloat coef = load(packed_coef);
+            const vfloat offset = load(packed_offset);
+            for (int sample = done; sample < done + run; ++sample)
+            {
+                mix[sample] += reduceAdd(mul(level, oscillator(ph, inc, table)));
+
+                ph = add(ph, inc); // wraps at the end of the cycle on its own
+                level = add(mul(level, coef), offset);
+            }
+            store(packed_level, level);
+            done += run;
+
+            for (int i = 0; i < count; ++i)
+            {
+                const int v = lanes[i];
+                env_level[v] = packed_level[i];
+                if (env_remaining[v] == EnvelopeSegment::endless)
+                    continue;
+                if ((env_remaining[v] -= run) == 0)
+                {
+                    finishSegment(v);
+                    packed_level[i] = env_level[v];
+                    packed_coef[i] = env_coef[v];
+                    packed_offset[i] = env_offset[v];
+                }
+            }
+        }
+
+        store(packed_phase, ph);
+        for (int i = 0; i < count; ++i)
+            phase[lanes[i]] = packed_phase[i];
+    }
+
+    int num_voices = 0;
+    double sample_rate = 44100.0;
+    AdsrParams adsr;
+    AdsrCoefficients envelope;
+    lane_vector<float> frequency;
+    lane_vector<uint32_t> phase;
+    lane_vector<uint32_t> phase_inc;
+    lane_vector<uint32_t> table_offset;
+    lane_vector<float> env_level;
+    lane_vector<float> env_coef;
+    lane_vector<float> env_offset;
+    std::vector<int> env_remaining; // samples to the end of the current segment
+    std::vector<EnvelopeStage> env_stage;
+    std::vector<uint8_t> is_active;
+    std::vector<int> key_code;
+    std::vector<int> sounding;      // lanes render() walks, [0, num_sounding)
+    std::vector<int> sounding_slot; // where each lane sits in sounding, or -1
+    int num_sounding = 0;
+};
@@ -0,0 +1,245 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "envelope.h"
+#include "voice_allocator.h"
+
+// note bookkeeping for voice types whose per-voice state doesn't fit VoiceBank's lanes (Sampler,
+// AdditiveBank): which voice each key holds, a scalar ADSR per voice, and stealing. a stolen note fades
+// out over a couple of milliseconds in one of a few spare voices while the new note starts; released
+// notes are stolen before held ones, oldest first. voices are a plain array scanned at note-on, there
+// are few of them and note-ons are rare next to samples.
+// audio thread only
+class VoiceSlots
+{
+public:
+    static constexpr int fade_voices = 8;
+
+    // drops every note. an attack of 0 starts notes at full level, for sounds that bring their own
+    void prepare(int new_polyphony, double sample_rate, const AdsrParams& params)
+    {
+        polyphony = new_polyphony;
+        instant_attack = params.attack_secs <= 0.0f;
+        envelope.compute(params, sample_rate);
+
+        const auto count = static_cast<std::size_t>(polyphony > 0 ? polyphony + fade_voices : 0);
+        voices.assign(count, Voice{});
+        key_voice.fill(-1);
+        notes_started = 0;
+    }
+
+    int size() const                 { return static_cast<int>(voices.size()); }
+    bool isSounding(int v) const     { return voices[v].stage != EnvelopeStage::Idle; }
+    // still attacking, decaying or sustaining, and not being faded out
+    bool isHeld(int v) const         { return !voices[v].fading && isSounding(v) && voices[v].stage != EnvelopeStage::Release; }
+
+    // the voice to start the note in, its old note (if any) already faded out into a spare voice or
+    // cut; -1 for an unmapped key, a key already held, or no voices at all
+    int noteOn(int key)
+    {
+        if (voices.empty() || key < 0 || key >= VoiceAllocator::max_keys || heldVoice(key) >= 0)
+            return -1;
+
+        int playing = 0;
+        for (const Voice& voice : voices)
+            playing += voice.stage != EnvelopeStage::Idle && !voice.fading;
+        if (playing >= polyphony)
+        {
+            int victim = oldest([](const Voice& voice) { return voice.stage == EnvelopeStage::Release && !voice.fading; });
+            if (victim < 0)
+                victim = oldest([](const Voice& voice) { return voice.stage != EnvelopeStage::Idle && !voice.fading; });
+            fadeOut(victim);
+        }
+
+        int v = oldest([](const Voice& voice) { return voice.stage == EnvelopeStage::Idle; });
+        if (v < 0)
+            v = oldest([](const Voice& voice) { return voice.fading; }); // every spare is busy: cut dead
+        if (v < 0)
+            return -1;
+
+        Voice& voice = voices[static_cast<std::size_t>(v)];
+        forget(v);
+        key_voice[key] = v;
+        voice.key = key;
+        voice.started = ++notes_started;
+        voice.fading = false;
+        voice.level = instant_attack ? 1.0f : 0.0f;
+        enterStage(voice, instant_attack ? EnvelopeStage::Decay : EnvelopeStage::Attack);
+        return v;
+    }
+
+    // the voice released, or -1 if the key wasn't held
+    int noteOff(int key)
+    {
+        const int v = heldVoice(key);
+        if (v < 0)
+            return -1;
+        forget(v);
+        enterStage(voices[static_cast<std::size_t>(v)], EnvelopeStage::Release);
+        return v;
+    }
+
+    // silences the voice now, e.g. when its sound has run out
+    void stop(int v)
+    {
+        forget(v);
+        Voice& voice = voices[static_cast<std::size_t>(v)];
+        voice.fading = false;
+        enterStage(voice, EnvelopeStage::Idle);
+    }
+
+    // the voice's envelope level for each of the next num_samples, into gain. returns how many samples
+    // it sounds for: fewer than num_samples when it goes idle on the way, which frees the voice
+    int envelopeGain(int v, float* gain, int num_samples)
+    {
+        Voice& voice = voices[static_cast<std::size_t>(v)];
+        int done = 0;
+        while (done < num_samples && voice.stage != EnvelopeStage::Idle)
+        {
+            const int run = std::min(num_samples - done, voice.remaining);
+            float level = voice.level;
+            for (int sample = done; sample < done + run; ++sample)
+            {
+                gain[sample] = level;
+                level = level * voice.coef + voice.offset;
+            }
+            voice.level = level;
+            done += run;
+
+            if (voice.remaining != EnvelopeSegment::endless && (voice.remaining -= run) == 0)
+                finishSegment(voice);
+        }
+        if (voice.stage == EnvelopeStage::Idle)
+            forget(v);
+        return done;
+    }
+
+private:
+    struct Voice
+    {
+        int key = -1;
+        uint64_t started = 0;
+        EnvelopeStage stage = EnvelopeStage::Idle;
+        bool fading = false; // stolen, on its way out in the fade_out segment
+        float level = 0.0f;
+        float coef = 0.0f;
+        float offset = 0.0f;
+        int remaining = EnvelopeSegment::endless;
+    };
+
+    int heldVoice(int key) const
+    {
+        if (key < 0 || key >= VoiceAllocator::max_keys)
+            return -1;
+        const int v = key_voice[key];
+        return v >= 0 && isHeld(v) ? v : -1;
+    }
+
+    // clears the key entry if it still points at this voice
+    void forget(int v)
+    {
+        const int key = voices[static_cast<std::size_t>(v)].key;
+        if (key >= 0 && key_voice[key] == v)
+            key_voice[key] = -1;
+    }
+
+    template <typename Predicate>
+    int oldest(Predicate&& matches) const
+    {
+        int found = -1;
+        for (int v = 0; v < size(); ++v)
+            if (matches(voices[static_cast<std::size_t>(v)]) && (found < 0 || voices[static_cast<std::size_t>(v)].started < voices[static_cast<std::size_t>(found)].started))
+                found = v;
+        return found;
+    }
+
+    void fadeOut(int v)
+    {
+        if (v < 0)
+            return;
+        forget(v);
+        Voice& voice = voices[static_cast<std::size_t>(v)];
+        voice.fading = true;
+        voice.stage = EnvelopeStage::Release;
+        enterSegment(voice, envelope.fade_out);
+        if (voice.remaining == 0)
+            enterStage(voice, EnvelopeStage::Idle);
+    }
+
+    static void enterSegment(Voice& voice, const EnvelopeSegment& segment)
+    {
+        voice.coef = segment.coef;
+        voice.offset = segment.offset;
+        voice.remaining = segment.samplesFrom(voice.level);
+    }
+
+    // the same stage machine as VoiceBank's, for one voice
+    void enterStage(Voice& voice, EnvelopeStage stage)
+    {
+        for (;;)
+        {
+            voice.stage = stage;
+            switch (stage)
+            {
+            case EnvelopeStage::Attack:
+                enterSegment(voice, envelope.attack);
+                if (voice.remaining > 0)
+                    return;
+                voice.level = 1.0f;
+                stage = EnvelopeStage::Decay;
+                break;
+            case EnvelopeStage::Decay:
+                enterSegment(voice, envelope.decay);
+                if (voice.remaining > 0)
+                    return;
+                stage = EnvelopeStage::Sustain;
+                break;
+            case EnvelopeStage::Sustain:
+                voice.level = static_cast<float>(envelope.sustain.goal);
+                voice.coef = 1.0f;
+                voice.offset = 0.0f;
+                voice.remaining = EnvelopeSegment::endless;
+                return;
+            case EnvelopeStage::Release:
+                enterSegment(voice, envelope.release);
+                if (voice.remaining > 0)
+                    return;
+                stage = EnvelopeStage::Idle;
+                break;
+            case EnvelopeStage::Idle:
+                voice.level = 0.0f;
+                voice.coef = 0.0f;
+                voice.offset = 0.0f;
+                voice.remaining = EnvelopeSegment::endless;
+                voice.fading = false;
+                return;
+            }
+        }
+    }
+
+    void finishSegment(Voice& voice)
+    {
+        switch (voice.stage)
+        {
+        case EnvelopeStage::Attack:
+            voice.level = 1.0f;
+            enterStage(voice, EnvelopeStage::Decay);
+            break;
+        case EnvelopeStage::Decay:
+            enterStage(voice, EnvelopeStage::Sustain);
+            break;
+        default:
+            enterStage(voice, EnvelopeStage::Idle);
+            break;
+        }
+    }
+
+    int polyphony = 0;
+    bool instant_attack = false;
+    AdsrCoefficients envelope;
+    std::vector<Voice> voices;
+    std::array<int, VoiceAllocator::max_keys> key_voice{};
+    uint64_t notes_started = 0;
+};
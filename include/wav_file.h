@@ -0,0 +1,90 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// streams 32-bit float PCM into a .wav file; the sizes in the header are patched in close().
+// float keeps renders bit-exact, so two bounces of the same score can be compared directly.
+// the RIFF sizes are 32 bits, so a file holds at most max_data_bytes of samples; write() stops there
+// and says so rather than letting the header wrap around
+class WavWriter
+{
+public:
+    static constexpr uint64_t max_data_bytes = 0xFFFFFFFFull - 36;
+
+    ~WavWriter() { close(); }
+
+    bool open(const std::string& path, int sample_rate, int num_channels)
+    {
+        close();
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        channels = std::max(num_channels, 1);
+        frames = 0;
+
+        const auto rate = static_cast<uint32_t>(sample_rate);
+        const auto block_align = static_cast<uint16_t>(channels * sizeof(float));
+        file.write("RIFF", 4);
+        put32(0); // patched in close()
+        file.write("WAVEfmt ", 8);
+        put32(16);
+        put16(3); // IEEE float
+        put16(static_cast<uint16_t>(channels));
+        put32(rate);
+        put32(rate * block_align);
+        put16(block_align);
+        put16(32);
+        file.write("data", 4);
+        put32(0); // patched in close()
+        return static_cast<bool>(file);
+    }
+
+    bool isOpen() const { return file.is_open(); }
+    bool isFull() const { return frames == maxFrames(); }
+
+    // interleaved frames; false if the file filled up, in which case only the frames that fit were written
+    bool write(const float* samples, int num_frames)
+    {
+        const uint64_t count = std::min(static_cast<uint64_t>(std::max(num_frames, 0)), maxFrames() - frames);
+        file.write(reinterpret_cast<const char*>(samples), static_cast<std::streamsize>(count * frameBytes()));
+        frames += count;
+        return count == static_cast<uint64_t>(std::max(num_frames, 0));
+    }
+
+    void close()
+    {
+        if (!file.is_open())
+            return;
+
+        const auto data_bytes = static_cast<uint32_t>(frames * frameBytes()); // never more than max_data_bytes
+        file.seekp(4);
+        put32(36 + data_bytes);
+        file.seekp(40);
+        put32(data_bytes);
+        file.close();
+    }
+
+private:
+    uint64_t frameBytes() const { return static_cast<uint64_t>(channels) * sizeof(float); }
+    uint64_t maxFrames() const  { return max_data_bytes / frameBytes(); }
+
+    // wav is little-endian whatever the host is
+    void put16(uint16_t value)
+    {
+        const char bytes[2] = { static_cast<char>(value), static_cast<char>(value >> 8) };
+        file.write(bytes, 2);
+    }
+
+    void put32(uint32_t value)
+    {
+        put16(static_cast<uint16_t>(value));
+        put16(static_cast<uint16_t>(value >> 16));
+    }
+
+    std::ofstream file;
+    int channels = 0;
+    uint64_t frames = 0;
+};
@@ -0,0 +1,123 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "oscillator.h"
+
+// reads one cycle from a band-limited table picked per voice, with linear interpolation.
+// table offsets point at a mip level inside the waveform's storage, see Wavetables::tableOffset
+struct WavetableOscillator
+{
+    static constexpr int table_bits = 11;
+    static constexpr int frac_bits  = 32 - table_bits;
+
+    const float* tables = nullptr;
+
+    simd::vfloat operator()(simd::vuint phase, simd::vuint /*increment*/, simd::vuint table_offset) const
+    {
+        using namespace simd;
+        const vuint index = add(shiftRight<frac_bits>(phase), table_offset);
+        const vfloat frac = mul(signedToFloat(bitAnd(phase, broadcast((1u << frac_bits) - 1u))),
+                                broadcast(1.0f / static_cast<float>(1u << frac_bits)));
+
+        const vfloat a = gather(tables, index);
+        const vfloat b = gather(tables, add(index, broadcast(1u)));
+        return add(a, mul(frac, sub(b, a)));
+    }
+};
+
+// one table per octave per waveform. a level only holds the harmonics that stay below Nyquist
+// for the highest note in its octave, so nothing above the key map's range can alias
+class Wavetables
+{
+public:
+    static constexpr int table_size        = 1 << WavetableOscillator::table_bits;
+    static constexpr int table_stride      = table_size + 1; // guard point for interpolation
+    static constexpr int num_levels        = 11;
+    static constexpr float lowest_frequency = 20.0f;         // level k covers [20·2^k, 20·2^(k+1)) Hz
+
+    // octave a note is read from; only depends on frequency, so it is fixed at note-on
+    static int levelFor(float frequency)
+    {
+        if (frequency < lowest_frequency * 2.0f)
+            return 0;
+        return std::min(static_cast<int>(std::log2(frequency / lowest_frequency)), num_levels - 1);
+    }
+
+    static uint32_t tableOffset(float frequency)
+    {
+        return static_cast<uint32_t>(levelFor(frequency) * table_stride);
+    }
+
+    // sums the harmonics of every waveform into every level; called from prepareToPlay
+    void build(double sample_rate)
+    {
+        // sin(2π·k·n/N) repeats every N samples, so every partial is a lookup into one sine cycle
+        std::vector<double> sine(table_size);
+        for (int n = 0; n < table_size; ++n)
+            sine[n] = std::sin(two_pi_d * n / table_size);
+
+        const double nyquist = sample_rate * 0.5;
+        for (auto waveform : { WaveformType::Sine, WaveformType::Sawtooth, WaveformType::Square, WaveformType::Triangle })
+        {
+            auto& storage = data[static_cast<std::size_t>(waveform)];
+            storage.assign(static_cast<std::size_t>(num_levels * table_stride), 0.0f);
+
+            for (int level = 0; level < num_levels; ++level)
+            {
+                const double top_frequency = lowest_frequency * std::pow(2.0, level + 1);
+                const int harmonics = (waveform == WaveformType::Sine)
+                    ? 1
+                    : std::clamp(static_cast<int>(nyquist / top_frequency), 1, table_size / 2 - 1);
+
+                float* table = &storage[static_cast<std::size_t>(level * table_stride)];
+                fillLevel(waveform, table, harmonics, sine);
+                table[table_size] = table[0];
+            }
+        }
+    }
+
+    WavetableOscillator oscillator(WaveformType waveform) const
+    {
+        return { data[static_cast<std::size_t>(waveform)].data() };
+    }
+
+private:
+    // Fourier series of the analytic shapes in oscillator.h, cut off after the given harmonic
+    static void fillLevel(WaveformType waveform, float* table, int harmonics, const std::vector<double>& sine)
+    {
+        constexpr unsigned mask = table_size - 1;
+        constexpr double pi = two_pi_d * 0.5;
+
+        for (int n = 0; n < table_size; ++n)
+        {
+            double value = 0.0;
+            for (int k = 1; k <= harmonics; ++k)
+            {
+                const unsigned at = (static_cast<unsigned>(k) * static_cast<unsigned>(n)) & mask;
+                switch (waveform)
+                {
+                case WaveformType::Sine:
+                    value += sine[at];
+                    break;
+                case WaveformType::Sawtooth: // rising ramp from -1 to 1
+                    value -= (2.0 / pi) * sine[at] / k;
+                    break;
+                case WaveformType::Square:   // +0.5 over the first half cycle, odd harmonics only
+                    if (k % 2 == 1)
+                        value += (2.0 / pi) * sine[at] / k;
+                    break;
+                case WaveformType::Triangle: // cosine series, peak of +1 at phase 0
+                    if (k % 2 == 1)
+                        value += (8.0 / (pi * pi)) * sine[(at + table_size / 4) & mask] / (static_cast<double>(k) * k);
+                    break;
+                }
+            }
+            table[n] = static_cast<float>(value);
+        }
+    }
+
+    std::array<std::vector<float>, 4> data;
+};
@@ -0,0 +1,291 @@
+// the interposers behind rt_check.h, only compiled with SYNTH_RT_CHECK (glibc only). linked into
+// the executable, these definitions win over libc's for every caller in the process; they check
+// whether the calling thread is inside an AudioScope and then forward to the real function.
+// allocation forwards through glibc's __libc_* entry points rather than dlsym, which itself allocates
+#include "rt_check.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void* pointer);
+}
+
+namespace
+{
+    // initial-exec so that touching these from inside malloc can never itself allocate
+    __attribute__((tls_model("initial-exec"))) thread_local int audio_depth = 0;
+    __attribute__((tls_model("initial-exec"))) thread_local bool reporting = false;
+
+    std::atomic<uint64_t> violation_count{ 0 };
+    constexpr uint64_t max_reports = 20; // counted past this, not printed
+    bool abort_on_violation = false;
+
+    using WriteFn = ssize_t (*)(int, const void*, size_t);
+    using ReadFn = ssize_t (*)(int, void*, size_t);
+    using FwriteFn = size_t (*)(const void*, size_t, size_t, FILE*);
+    using FputsFn = int (*)(const char*, FILE*);
+    using PutsFn = int (*)(const char*);
+    using FflushFn = int (*)(FILE*);
+    using MutexFn = int (*)(pthread_mutex_t*);
+    using CondWaitFn = int (*)(pthread_cond_t*, pthread_mutex_t*);
+    using CondTimedWaitFn = int (*)(pthread_cond_t*, pthread_mutex_t*, const timespec*);
+    using CondClockWaitFn = int (*)(pthread_cond_t*, pthread_mutex_t*, clockid_t, const timespec*);
+    using RwlockFn = int (*)(pthread_rwlock_t*);
+    using SemFn = int (*)(sem_t*);
+    using SemTimedFn = int (*)(sem_t*, const timespec*);
+    using NanosleepFn = int (*)(const timespec*, timespec*);
+    using UsleepFn = int (*)(useconds_t);
+
+    template <typename Fn>
+    Fn real(Fn& cached, const char* name)
+    {
+        if (cached == nullptr)
+            cached = reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+        return cached;
+    }
+
+    WriteFn real_write = nullptr;
+    ReadFn real_read = nullptr;
+    FwriteFn real_fwrite = nullptr;
+    FputsFn real_fputs = nullptr;
+    PutsFn real_puts = nullptr;
+    FflushFn real_fflush = nullptr;
+    MutexFn real_mutex_lock = nullptr;
+    CondWaitFn real_cond_wait = nullptr;
+    CondTimedWaitFn real_cond_timedwait = nullptr;
+    CondClockWaitFn real_cond_clockwait = nullptr;
+    RwlockFn real_rwlock_rdlock = nullptr;
+    RwlockFn real_rwlock_wrlock = nullptr;
+    SemFn real_sem_wait = nullptr;
+    SemTimedFn real_sem_timedwait = nullptr;
+    NanosleepFn real_nanosleep = nullptr;
+    UsleepFn real_usleep = nullptr;
+
+    void say(const char* text)
+    {
+        real(real_write, "write")(STDERR_FILENO, text, std::strlen(text));
+    }
+
+    // straight to fd 2 with no stdio and no allocation: this runs inside malloc
+    void violation(const char* what)
+    {
+        if (audio_depth == 0 || reporting)
+            return;
+        reporting = true;
+
+        const uint64_t count = violation_count.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (count <= max_reports)
+        {
+            say("rt-check: ");
+            say(what);
+            say(" on the audio thread\n");
+            void* frames[48];
+            const int depth = backtrace(frames, 48);
+            backtrace_symbols_fd(frames + 2, depth - 2, STDERR_FILENO); // minus violation() and the interposer
+            if (count == max_reports)
+                say("rt-check: further violations are counted but not printed\n");
+        }
+        if (abort_on_violation)
+            std::abort();
+
+        reporting = false;
+    }
+
+    // resolve everything and let backtrace() load its unwinder now, before any audio thread exists
+    __attribute__((constructor)) void setUp()
+    {
+        real(real_write, "write");
+        real(real_read, "read");
+        real(real_fwrite, "fwrite");
+        real(real_fputs, "fputs");
+        real(real_puts, "puts");
+        real(real_fflush, "fflush");
+        real(real_mutex_lock, "pthread_mutex_lock");
+        real(real_cond_wait, "pthread_cond_wait");
+        real(real_cond_timedwait, "pthread_cond_timedwait");
+        real(real_cond_clockwait, "pthread_cond_clockwait");
+        real(real_rwlock_rdlock, "pthread_rwlock_rdlock");
+        real(real_rwlock_wrlock, "pthread_rwlock_wrlock");
+        real(real_sem_wait, "sem_wait");
+        real(real_sem_timedwait, "sem_timedwait");
+        real(real_nanosleep, "nanosleep");
+        real(real_usleep, "usleep");
+
+        void* frame = nullptr;
+        backtrace(&frame, 1);
+
+        const char* abort_env = std::getenv("SYNTH_RT_CHECK_ABORT");
+        abort_on_violation = abort_env != nullptr && abort_env[0] == '1';
+    }
+}
+
+namespace rtcheck
+{
+    void enterAudioThread() { ++audio_depth; }
+    void leaveAudioThread() { --audio_depth; }
+    uint64_t violations()   { return violation_count.load(std::memory_order_relaxed); }
+}
+
+extern "C"
+{
+    void* malloc(size_t size)
+    {
+        violation("malloc");
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        violation("calloc");
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size)
+    {
+        violation("realloc");
+        return __libc_realloc(pointer, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        violation("aligned_alloc");
+        return __libc_memalign(alignment, size);
+    }
+
+    void* memalign(size_t alignment, size_t size)
+    {
+        violation("memalign");
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** pointer, size_t alignment, size_t size)
+    {
+        violation("posix_memalign");
+        if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+        void* memory = __libc_memalign(alignment, size);
+        if (memory == nullptr && size != 0)
+            return ENOMEM;
+        *pointer = memory;
+        return 0;
+    }
+
+    void free(void* pointer)
+    {
+        if (pointer != nullptr)
+            violation("free");
+        __libc_free(pointer);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex)
+    {
+        violation("pthread_mutex_lock");
+        return real(real_mutex_lock, "pthread_mutex_lock")(mutex);
+    }
+
+    int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        violation("pthread_cond_wait");
+        return real(real_cond_wait, "pthread_cond_wait")(condition, mutex);
+    }
+
+    int pthread_cond_timedwait(pthread_cond_t* condition, pthread_mutex_t* mutex, const timespec* deadline)
+    {
+        violation("pthread_cond_timedwait");
+        return real(real_cond_timedwait, "pthread_cond_timedwait")(condition, mutex, deadline);
+    }
+
+    // what std::condition_variable's wait_for and wait_until call on glibc 2.30 and later
+    int pthread_cond_clockwait(pthread_cond_t* condition, pthread_mutex_t* mutex, clockid_t clock, const timespec* deadline)
+    {
+        violation("pthread_cond_clockwait");
+        return real(real_cond_clockwait, "pthread_cond_clockwait")(condition, mutex, clock, deadline);
+    }
+
+    int pthread_rwlock_rdlock(pthread_rwlock_t* lock)
+    {
+        violation("pthread_rwlock_rdlock");
+        return real(real_rwlock_rdlock, "pthread_rwlock_rdlock")(lock);
+    }
+
+    int pthread_rwlock_wrlock(pthread_rwlock_t* lock)
+    {
+        violation("pthread_rwlock_wrlock");
+        return real(real_rwlock_wrlock, "pthread_rwlock_wrlock")(lock);
+    }
+
+    int sem_wait(sem_t* semaphore)
+    {
+        violation("sem_wait");
+        return real(real_sem_wait, "sem_wait")(semaphore);
+    }
+
+    int sem_timedwait(sem_t* semaphore, const timespec* deadline)
+    {
+        violation("sem_timedwait");
+        return real(real_sem_timedwait, "sem_timedwait")(semaphore, deadline);
+    }
+
+    ssize_t write(int fd, const void* data, size_t size)
+    {
+        violation("write");
+        return real(real_write, "write")(fd, data, size);
+    }
+
+    ssize_t read(int fd, void* data, size_t size)
+    {
+        violation("read");
+        return real(real_read, "read")(fd, data, size);
+    }
+
+    // stdio writes through libc's internal write, so std::cout and printf-style logging are caught here
+    size_t fwrite(const void* data, size_t size, size_t count, FILE* file)
+    {
+        violation("fwrite");
+        return real(real_fwrite, "fwrite")(data, size, count, file);
+    }
+
+    int fputs(const char* text, FILE* file)
+    {
+        violation("fputs");
+        return real(real_fputs, "fputs")(text, file);
+    }
+
+    int puts(const char* text)
+    {
+        violation("puts");
+        return real(real_puts, "puts")(text);
+    }
+
+    int fflush(FILE* file)
+    {
+        violation("fflush");
+        return real(real_fflush, "fflush")(file);
+    }
+
+    int nanosleep(const timespec* duration, timespec* remaining)
+    {
+        violation("nanosleep");
+        return real(real_nanosleep, "nanosleep")(duration, remaining);
+    }
+
+    int usleep(useconds_t micros)
+    {
+        violation("usleep");
+        return real(real_usleep, "usleep")(micros);
+    }
+}
@@ -0,0 +1,360 @@
+#include "synth_engine.h"
+#include "rt_check.h"
+#include <algorithm>
+#include <thread>
+
+SynthEngine::SynthEngine(int polyphony)
+{
+    voices.resize(polyphony);
+}
+
+void SynthEngine::setRenderThreads(int num_workers)
+{
+    // a worker that has to share a core with the audio thread only gets in its way
+    const int spare_cores = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+    if (spare_cores >= 0)
+        num_workers = std::min(num_workers, spare_cores);
+    pool = num_workers > 0 ? std::make_unique<RenderPool>(num_workers) : nullptr;
+}
+
+int SynthEngine::addScore(CompiledScore score)
+{
+    scores.push_back(std::move(score));
+    return numScores() - 1;
+}
+
+void SynthEngine::prepare(double new_sample_rate, int max_block_size)
+{
+    sample_rate = new_sample_rate;
+    prepared_sample_rate.store(sample_rate, std::memory_order_relaxed);
+    max_block = max_block_size;
+    voices.setSampleRate(sample_rate);
+    block_clock.reset(sample_rate);
+    sequencer.prepare(sample_rate);
+    wavetables.build(sample_rate);
+    sampler.prepare(sample_rate, voices.size(), bank.envelopeParams());
+    additive.prepare(sample_rate, voices.size(), bank.envelopeParams());
+    spectral.prepare(sample_rate, voices.size(), bank.envelopeParams());
+    load.reset();
+
+    const auto shares = static_cast<std::size_t>(pool != nullptr ? pool->size() : 0);
+    scratch.assign(shares, std::vector<float, simd::AlignedAllocator<float>>(static_cast<std::size_t>(max_block), 0.0f));
+}
+
+void SynthEngine::process(float* const* channels, int num_channels, int num_samples)
+{
+    if (num_channels <= 0 || num_samples <= 0)
+        return;
+    rtcheck::AudioScope audio_scope;
+    load.beginCallback(nowNanos());
+
+    // voices accumulate straight into the first channel, which is then scaled and copied to the others
+    float* mix = channels[0];
+    std::fill(mix, mix + num_samples, 0.0f);
+
+    const WaveformType new_waveform = waveform.load(std::memory_order_relaxed);
+    const OscillatorMode new_oscillator_mode = oscillator_mode.load(std::memory_order_relaxed);
+    const VoiceType new_voice_type = voice_type.load(std::memory_order_relaxed);
+    const StealPolicy new_steal_policy = steal_policy.load(std::memory_order_relaxed);
+    // a pre-rendered melody has the sound it was rendered with, stolen voices included; changing it
+    // mid-melody goes live from here
+    const bool sound_changed = new_waveform != block_waveform || new_oscillator_mode != block_oscillator_mode ||
+                               new_voice_type != block_voice_type || new_steal_policy != voices.stealPolicy();
+    if (sound_changed && handOverToLive())
+        sequencer.seek(sequencer.positionSecs());
+    block_waveform = new_waveform;
+    block_oscillator_mode = new_oscillator_mode;
+    block_voice_type = new_voice_type;
+    voices.setStealPolicy(new_steal_policy);
+    applySequencerCommands();
+
+    // apply every pending keyboard and melody event at its own sample offset, in time order,
+    // rendering the stretch before each one
+    const int64_t block_time = block_clock.beginBlock();
+    int position = 0;
+    for (;;)
+    {
+        const NoteEvent* queued = note_events.peek();
+        if (queued != nullptr && queued->time_ns > block_time)
+            queued = nullptr; // arrived while this block was being rendered, belongs to the next one
+        const int queued_offset = queued != nullptr ? block_clock.offsetFor(queued->time_ns, num_samples) : num_samples;
+
+        int scored_offset = num_samples;
+        const ScoreEvent* scored = sequencer.next(num_samples, scored_offset);
+
+        if (queued == nullptr && scored == nullptr)
+            break;
+
+        const bool take_score = scored != nullptr && (queued == nullptr || scored_offset < queued_offset);
+        const int offset = take_score ? scored_offset : queued_offset;
+        if (offset > position)
+        {
+            renderVoices(mix + position, offset - position);
+            position = offset;
+        }
+
+        if (take_score)
+        {
+            const ScoreEvent event = *scored; // consume() may pop it off a stream
+            if (sequencer.consume())
+                applyScoreEvent(event);
+        }
+        else
+        {
+            applyNoteEvent(*queued);
+            note_events.pop();
+        }
+    }
+    renderVoices(mix + position, num_samples - position);
+    sequencer.advance(num_samples);
+
+    for (int sample = 0; sample < num_samples; ++sample)
+        mix[sample] *= output_gain;
+    mixRenderedAudio(mix, num_samples);
+    for (int channel = 1; channel < num_channels; ++channel)
+        std::copy(mix, mix + num_samples, channels[channel]);
+    recorder.write(channels, num_channels, num_samples);
+    load.endCallback(nowNanos(), num_samples, sample_rate);
+}
+
+// voice allocation happens here, never on the message thread
+void SynthEngine::applyNoteEvent(const NoteEvent& event)
+{
+    if (event.type == NoteEvent::Type::NoteOn)
+        noteOn(event.key_code, event.frequency, event.priority);
+    else
+        noteOff(event.key_code);
+}
+
+// melody notes also go back to the message thread for display
+void SynthEngine::applyScoreEvent(const ScoreEvent& event)
+{
+    if (!melody_muted)
+    {
+        if (event.is_on)
+            noteOn(event.key_code, event.frequency * sequencer.pitchRatio(), melody_priority);
+        else
+            noteOff(event.key_code);
+    }
+
+    const auto type = event.is_on ? NoteEvent::Type::NoteOn : NoteEvent::Type::NoteOff;
+    played_events.push({ type, event.key_code, event.frequency, 0 });
+}
+
+// the sampler and the additive and spectral banks have no priorities of their own, they steal the oldest note
+void SynthEngine::noteOn(int key, float frequency, int priority)
+{
+    const auto presets = spectrumPresets();
+    const int preset = spectrum.load(std::memory_order_relaxed);
+    if (block_voice_type == VoiceType::Sampler && sampler.hasSamples())
+        sampler.noteOn(key, frequency);
+    else if (block_voice_type == VoiceType::Additive && preset >= 0 && preset < static_cast<int>(presets.size()))
+        additive.noteOn(key, frequency, presets[static_cast<std::size_t>(preset)]);
+    else if (block_voice_type == VoiceType::Oscillator && block_oscillator_mode == OscillatorMode::Spectral)
+        spectral.noteOn(key, frequency, waveformSpectrum(block_waveform));
+    else
+        voices.noteOn(key, frequency, priority);
+}
+
+// to all of them, the key may have gone down before the voice type changed
+void SynthEngine::noteOff(int key)
+{
+    voices.noteOff(key);
+    sampler.noteOff(key);
+    additive.noteOff(key);
+    spectral.noteOff(key);
+}
+
+// the offs and ons these generate come out of sequencer.next() at the top of the block
+void SynthEngine::applySequencerCommands()
+{
+    // popped only once applied, so an empty queue means every command has taken effect
+    while (const SequencerCommand* next = sequencer_commands.peek())
+    {
+        const SequencerCommand& command = *next;
+        switch (command.type)
+        {
+        case SequencerCommand::Type::Play:
+            if (command.score < 0 || command.score >= numScores())
+                break;
+            // whatever the previous melody left sounding is released while it's still live
+            stopMelody();
+            setRenderedAudio(command.audio, command.audio_length);
+            melody_muted = command.audio != nullptr;
+            sequencer.start(&scores[static_cast<std::size_t>(command.score)], command.tempo, command.transpose);
+            break;
+        case SequencerCommand::Type::PlayStream:
+            if (command.stream == nullptr)
+                break;
+            stopMelody();
+            sequencer.startStream(command.stream, command.tempo, command.transpose);
+            break;
+        case SequencerCommand::Type::Stop:
+            sequencer.stop();
+            setRenderedAudio(nullptr, 0);
+            break;
+        case SequencerCommand::Type::Pause:
+            sequencer.pause();
+            break;
+        case SequencerCommand::Type::Resume:
+            sequencer.resume();
+            break;
+        case SequencerCommand::Type::Seek:
+            handOverToLive();
+            sequencer.seek(command.secs);
+            break;
+        case SequencerCommand::Type::SetLoop:
+            if (handOverToLive())
+                sequencer.seek(sequencer.positionSecs()); // start what the recording was playing
+            sequencer.setLoop(command.secs, command.loop_end);
+            break;
+        }
+        sequencer_commands.pop();
+    }
+}
+
+// stops the melody and applies its note-offs right away, at the start of the block
+void SynthEngine::stopMelody()
+{
+    sequencer.stop();
+    int offset = 0;
+    while (const ScoreEvent* next = sequencer.next(0, offset))
+    {
+        const ScoreEvent event = *next;
+        if (sequencer.consume())
+            applyScoreEvent(event);
+    }
+    setRenderedAudio(nullptr, 0);
+    melody_muted = false;
+}
+
+void SynthEngine::setRenderedAudio(const float* audio, int64_t length)
+{
+    rendered_audio = audio;
+    rendered_length = audio != nullptr ? length : 0;
+    rendered_position = 0;
+    rendered_in_use.store(audio, std::memory_order_release);
+}
+
+// a recording can only play straight through; seeking or looping one synthesizes the melody live from there.
+// true if a recording was playing
+bool SynthEngine::handOverToLive()
+{
+    if (rendered_audio == nullptr)
+        return false;
+    setRenderedAudio(nullptr, 0);
+    melody_muted = false;
+    return true;
+}
+
+// a pre-rendered melody follows the sequencer's pause and ends with it
+void SynthEngine::mixRenderedAudio(float* mix, int num_samples)
+{
+    if (rendered_audio == nullptr || sequencer.isPaused())
+        return;
+
+    const auto count = static_cast<int>(std::min<int64_t>(num_samples, rendered_length - rendered_position));
+    const float* audio = rendered_audio + rendered_position;
+    for (int sample = 0; sample < count; ++sample)
+        mix[sample] += audio[sample];
+    rendered_position += count;
+    if (rendered_position >= rendered_length)
+        setRenderedAudio(nullptr, 0);
+}
+
+void SynthEngine::renderVoices(float* mix, int num_samples)
+{
+    if (num_samples <= 0)
+        return;
+
+    switch (block_waveform)
+    {
+    case WaveformType::Sine:
+        renderWaveform<WaveformType::Sine>(mix, num_samples);
+        break;
+    case WaveformType::Sawtooth:
+        renderWaveform<WaveformType::Sawtooth>(mix, num_samples);
+        break;
+    case WaveformType::Square:
+        renderWaveform<WaveformType::Square>(mix, num_samples);
+        break;
+    case WaveformType::Triangle:
+        renderWaveform<WaveformType::Triangle>(mix, num_samples);
+        break;
+    }
+    voices.reclaim();
+    sampler.render(mix, num_samples);
+    additive.render(mix, num_samples);
+    spectral.render(mix, num_samples);
+}
+
+template <WaveformType W>
+void SynthEngine::renderWaveform(float* mix, int num_samples)
+{
+    switch (block_oscillator_mode)
+    {
+    case OscillatorMode::Analytic:
+        renderBank(mix, num_samples, AnalyticOscillator<W>{});
+        break;
+    case OscillatorMode::Wavetable:
+        renderBank(mix, num_samples, wavetables.oscillator(W));
+        break;
+    case OscillatorMode::PolyBlep:
+        renderBank(mix, num_samples, PolyBlepOscillator<W>{});
+        break;
+    case OscillatorMode::Spectral:
+        // new notes go to the spectral bank; the ones started before the switch finish on wavetables
+        renderBank(mix, num_samples, wavetables.oscillator(W));
+        break;
+    }
+}
+
+// shares get fixed, contiguous ranges of voice groups and a buffer each. the buffers are summed in
+// share order afterwards, so the output doesn't depend on which thread finished first
+template <typename Oscillator>
+void SynthEngine::renderBank(float* mix, int num_samples, const Oscillator& oscillator)
+{
+    if (pool == nullptr || bank.numSounding() < parallel_threshold || num_samples > max_block
+        || scratch.size() != static_cast<std::size_t>(pool->size()))
+    {
+        bank.render(mix, num_samples, oscillator);
+        return;
+    }
+
+    const int groups = bank.numGroups();
+    const int shares = pool->size();
+    auto task = [&](int share) {
+        float* out = scratch[static_cast<std::size_t>(share)].data();
+        std::fill(out, out + num_samples, 0.0f);
+        bank.renderGroups(groups * share / shares, groups * (share + 1) / shares, out, num_samples, oscillator);
+    };
+    pool->run(task);
+
+    for (const auto& out : scratch)
+        for (int sample = 0; sample < num_samples; ++sample)
+            mix[sample] += out[static_cast<std::size_t>(sample)];
+}
+
+std::vector<float> renderOffline(const CompiledScore& score, const OfflineRenderSettings& settings)
+{
+    SynthEngine engine(settings.polyphony);
+    const int index = engine.addScore(score);
+    engine.setWaveform(settings.waveform);
+    engine.setOscillatorMode(settings.oscillator_mode);
+    engine.setStealPolicy(settings.steal_policy);
+    engine.prepare(settings.sample_rate, settings.block_size);
+
+    const auto block_size = static_cast<std::size_t>(settings.block_size);
+    std::vector<float> output;
+    output.reserve(static_cast<std::size_t>((score.lengthSecs() / settings.tempo + 1.0) * settings.sample_rate) + block_size);
+    std::vector<float> block(block_size);
+    float* channels[1] = { block.data() };
+
+    engine.pushSequencerCommand({ SequencerCommand::Type::Play, index, 0.0, 0.0, settings.tempo, settings.transpose });
+    do
+    {
+        engine.process(channels, 1, settings.block_size);
+        output.insert(output.end(), block.begin(), block.end());
+    } while (engine.isMelodyPlaying());
+    return output;
+}
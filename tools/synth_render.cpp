@@ -0,0 +1,550 @@
+// bounces melodies through SynthEngine to .wav files, with no audio device and no GUI,
+// and prints how much faster than real time the rendering ran. e.g.
+//   synth_render --melody all --rate 48000 --block 512 --waveform sawtooth --out renders/
+//   synth_render --score my_tune.txt --oscillator polyblep
+//   synth_render --melody melody_jazz --tempo 0.8 --transpose -3
+//   synth_render --midi prelude.mid --oscillator polyblep
+//   synth_render --batch --jobs 8 --out renders/
+//   synth_render --melody all --samples piano/
+//   synth_render --melody all --spectrum bell
+//   synth_render --melody all --rt-check     (in a -DSYNTH_RT_CHECK=ON build)
+// --batch renders every chosen melody at every chosen waveform and rate (all melodies, all four
+// waveforms and 44.1/48/96 kHz unless narrowed down), one engine per file, spread over --jobs threads.
+// every file comes out the same whatever the thread count. files are named <melody>_<waveform>_<rate>.wav
+// in a batch or whenever several waveforms or rates are given, <melody>.wav otherwise.
+// --rt-check fails the run if anything inside the audio callback allocated, locked or did I/O
+// a score file has one note per line, "<key> <start secs> <duration secs>", keys as on the keyboard
+// (e.g. "K 0.33 0.3"); '#' starts a comment. a --midi file (SMF type 0 or 1) is streamed while it plays.
+// --samples plays everything on the sampler instead, from a directory of .wav files named by note
+// --spectrum plays everything on the additive voices instead, with one of the spectrumPresets()
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "melodies.h"
+#include "midi_file.h"
+#include "rt_check.h"
+#include "sampler.h"
+#include "synth_engine.h"
+#include "wav_file.h"
+
+namespace
+{
+    struct Settings
+    {
+        std::vector<std::string> melodies;
+        std::vector<std::string> score_files;
+        std::vector<std::string> midi_files;
+        std::vector<double> sample_rates;
+        std::vector<WaveformType> waveforms;
+        int block_size = 512;
+        int render_threads = 0;
+        double tempo = 1.0; // on top of each melody's own
+        int transpose = 0;
+        int parallel_threshold = SynthEngine::default_parallel_threshold;
+        OscillatorMode oscillator_mode = OscillatorMode::Wavetable;
+        std::filesystem::path out_dir = ".";
+        std::string samples_dir;
+        int spectrum = -1; // spectrumPresets() index, -1 for oscillators
+        bool batch = false;
+        bool rt_check = false;
+        int jobs = 0; // batch threads, 0 for one per core
+    };
+
+    constexpr WaveformType all_waveforms[] = { WaveformType::Sine, WaveformType::Sawtooth, WaveformType::Square, WaveformType::Triangle };
+
+    const char* waveformName(WaveformType waveform)
+    {
+        switch (waveform)
+        {
+        case WaveformType::Sine:     return "sine";
+        case WaveformType::Sawtooth: return "sawtooth";
+        case WaveformType::Square:   return "square";
+        default:                     return "triangle";
+        }
+    }
+
+    void usage()
+    {
+        std::fprintf(stderr,
+            "usage: synth_render [--melody NAME|all]... [--score FILE]... [--midi FILE]...\n"
+            "                    [--rate HZ]... [--block N]\n"
+            "                    [--waveform sine|sawtooth|square|triangle|all]...\n"
+            "                    [--oscillator wavetable|polyblep|analytic|spectral] [--out DIR]\n"
+            "                    [--threads N] [--parallel-threshold VOICES] [--batch] [--jobs N]\n"
+            "                    [--rt-check] [--tempo X] [--transpose SEMITONES] [--samples DIR]\n"
+            "                    [--spectrum organ|bell|bright|hollow]\n"
+            "melodies:");
+        for (const auto& melody : melodyCatalog())
+            std::fprintf(stderr, " %s", melody.name);
+        std::fprintf(stderr, "\n");
+    }
+
+    bool parseArgs(int argc, char** argv, Settings& settings)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            if (arg == "--batch" || arg == "--rt-check")
+            {
+                (arg == "--batch" ? settings.batch : settings.rt_check) = true;
+                continue;
+            }
+            if (i + 1 >= argc)
+                return false;
+            const std::string value = argv[++i];
+
+            if (arg == "--melody")
+                settings.melodies.push_back(value);
+            else if (arg == "--score")
+                settings.score_files.push_back(value);
+            else if (arg == "--midi")
+                settings.midi_files.push_back(value);
+            else if (arg == "--rate")
+                settings.sample_rates.push_back(std::atof(value.c_str()));
+            else if (arg == "--block")
+                settings.block_size = std::atoi(value.c_str());
+            else if (arg == "--threads")
+                settings.render_threads = std::atoi(value.c_str());
+            else if (arg == "--parallel-threshold")
+                settings.parallel_threshold = std::atoi(value.c_str());
+            else if (arg == "--tempo")
+                settings.tempo = std::atof(value.c_str());
+            else if (arg == "--transpose")
+                settings.transpose = std::atoi(value.c_str());
+            else if (arg == "--jobs")
+                settings.jobs = std::atoi(value.c_str());
+            else if (arg == "--out")
+                settings.out_dir = value;
+            else if (arg == "--samples")
+                settings.samples_dir = value;
+            else if (arg == "--spectrum")
+            {
+                const auto presets = spectrumPresets();
+                const auto found = std::find_if(presets.begin(), presets.end(), [&](const Spectrum& spectrum) { return value == spectrum.name; });
+                if (found == presets.end())
+                    return false;
+                settings.spectrum = static_cast<int>(found - presets.begin());
+            }
+            else if (arg == "--waveform")
+            {
+                if (value == "all")
+                    settings.waveforms.insert(settings.waveforms.end(), std::begin(all_waveforms), std::end(all_waveforms));
+                else if (value == "sine")     settings.waveforms.push_back(WaveformType::Sine);
+                else if (value == "sawtooth") settings.waveforms.push_back(WaveformType::Sawtooth);
+                else if (value == "square")   settings.waveforms.push_back(WaveformType::Square);
+                else if (value == "triangle") settings.waveforms.push_back(WaveformType::Triangle);
+                else return false;
+            }
+            else if (arg == "--oscillator")
+            {
+                if (value == "wavetable")     settings.oscillator_mode = OscillatorMode::Wavetable;
+                else if (value == "polyblep") settings.oscillator_mode = OscillatorMode::PolyBlep;
+                else if (value == "analytic") settings.oscillator_mode = OscillatorMode::Analytic;
+                else if (value == "spectral") settings.oscillator_mode = OscillatorMode::Spectral;
+                else return false;
+            }
+            else
+                return false;
+        }
+
+        if (settings.melodies.empty() && settings.score_files.empty() && settings.midi_files.empty())
+            settings.melodies.push_back(settings.batch ? "all" : melodyCatalog().front().name);
+        if (settings.waveforms.empty())
+        {
+            if (settings.batch)
+                settings.waveforms.assign(std::begin(all_waveforms), std::end(all_waveforms));
+            else
+                settings.waveforms.push_back(WaveformType::Sine);
+        }
+        if (settings.sample_rates.empty())
+        {
+            if (settings.batch)
+                settings.sample_rates = { 44100.0, 48000.0, 96000.0 };
+            else
+                settings.sample_rates.push_back(48000.0);
+        }
+        if (settings.jobs <= 0)
+            settings.jobs = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+        // a value given twice would render the same file twice
+        const auto dropRepeats = [](auto& values) {
+            for (std::size_t i = 0; i < values.size(); ++i)
+                values.erase(std::remove(values.begin() + static_cast<std::ptrdiff_t>(i) + 1, values.end(), values[i]), values.end());
+        };
+        dropRepeats(settings.waveforms);
+        dropRepeats(settings.sample_rates);
+
+        const bool rates_ok = std::all_of(settings.sample_rates.begin(), settings.sample_rates.end(), [](double rate) { return rate > 0.0; });
+        return rates_ok && settings.block_size > 0 && settings.tempo > 0.0;
+    }
+
+    bool readScoreFile(const std::string& path, std::vector<MelodyNote>& notes)
+    {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string key;
+            MelodyNote note{};
+            if (!(fields >> key))
+                continue;
+            if (!(fields >> note.startTimeSecs >> note.durationSecs))
+                return false;
+            note.keyCode = key.size() == 1 ? key[0] : std::atoi(key.c_str());
+            notes.push_back(note);
+        }
+        return true;
+    }
+
+    struct Job
+    {
+        std::string name; // output file stem
+        const CompiledScore* score = nullptr; // or
+        std::string midi_path;
+        double tempo = 1.0;
+        int transpose = 0;
+        WaveformType waveform = WaveformType::Sine;
+        double sample_rate = 48000.0;
+    };
+
+    struct JobResult
+    {
+        bool ok = false;
+        double audio_secs = 0.0;
+        double dsp_secs = 0.0;
+        std::size_t notes = 0;
+        uint64_t underruns = 0;
+        LoadStats load; // per block, against the block's real-time period
+    };
+
+    // plays one score through a fresh engine until it and its last release are over. nothing is
+    // shared between jobs, so they can run on any thread in any order and still write the same file
+    JobResult bounce(const Job& job, const Settings& settings, const SampleSet* samples)
+    {
+        JobResult result;
+        const auto path = settings.out_dir / (job.name + ".wav");
+        WavWriter wav;
+        if (!wav.open(path.string(), static_cast<int>(job.sample_rate), 2))
+        {
+            std::fprintf(stderr, "can't write %s\n", path.string().c_str());
+            return result;
+        }
+
+        // a MIDI file streams from its own loader thread, a fresh one for every job
+        MidiStream midi;
+        if (job.score == nullptr && !midi.open(job.midi_path))
+        {
+            std::fprintf(stderr, "%s\n", midi.error().c_str());
+            return result;
+        }
+
+        SynthEngine engine;
+        const int score = job.score != nullptr ? engine.addScore(*job.score) : 0;
+        engine.setWaveform(job.waveform);
+        engine.setOscillatorMode(settings.oscillator_mode);
+        engine.setRenderThreads(settings.render_threads);
+        engine.setParallelThreshold(settings.parallel_threshold);
+        if (samples != nullptr)
+        {
+            engine.setSampleSet(samples);
+            engine.setVoiceType(VoiceType::Sampler);
+        }
+        else if (settings.spectrum >= 0)
+        {
+            engine.setSpectrum(settings.spectrum);
+            engine.setVoiceType(VoiceType::Additive);
+        }
+        engine.prepare(job.sample_rate, settings.block_size);
+
+        const int block_size = settings.block_size;
+        std::vector<float> left(static_cast<std::size_t>(block_size));
+        std::vector<float> right(static_cast<std::size_t>(block_size));
+        std::vector<float> stereo(static_cast<std::size_t>(block_size) * 2);
+        float* channels[2] = { left.data(), right.data() };
+
+        using clock = std::chrono::steady_clock;
+        long long frames = 0;
+        if (job.score != nullptr)
+            engine.pushSequencerCommand({ SequencerCommand::Type::Play, score, 0.0, 0.0, job.tempo, job.transpose });
+        else
+            engine.pushSequencerCommand({ SequencerCommand::Type::PlayStream, 0, 0.0, 0.0, job.tempo, job.transpose, midi.scoreStream() });
+        do
+        {
+            // offline there's no deadline, so let the loader get past this block first; a late event
+            // would otherwise make the render differ from run to run
+            const double block_end_secs = static_cast<double>(frames + block_size + 1) / job.sample_rate * job.tempo;
+            while (job.score == nullptr && !midi.scoreStream()->hasEventsUntil(block_end_secs))
+                std::this_thread::yield();
+            // likewise for the sampler's disk streams
+            while (!engine.isSamplerStreamedAhead(block_size))
+                std::this_thread::yield();
+
+            const auto start = clock::now();
+            engine.process(channels, 2, block_size);
+            result.dsp_secs += std::chrono::duration<double>(clock::now() - start).count();
+
+            for (int n = 0; n < block_size; ++n)
+            {
+                stereo[2 * n] = left[n];
+                stereo[2 * n + 1] = right[n];
+            }
+            if (!wav.write(stereo.data(), block_size))
+            {
+                std::fprintf(stderr, "%s reached the 4 GiB .wav limit\n", path.string().c_str());
+                return result;
+            }
+            frames += block_size;
+        } while (engine.isMelodyPlaying());
+
+        result.ok = true;
+        result.notes = job.score != nullptr ? job.score->numNotes() : midi.numNotesDecoded();
+        result.load = engine.loadStats();
+        result.underruns = engine.samplerUnderruns();
+        result.audio_secs = static_cast<double>(frames) / job.sample_rate;
+        return result;
+    }
+
+    void printResult(const Job& job, const JobResult& result, const Settings& settings)
+    {
+        const auto path = settings.out_dir / (job.name + ".wav");
+        std::printf("%-36s %5zu notes %8.2f s audio %9.2f ms dsp %9.1fx real time  max load %5.1f%%  -> %s\n",
+                    job.name.c_str(), result.notes, result.audio_secs, result.dsp_secs * 1e3,
+                    result.dsp_secs > 0.0 ? result.audio_secs / result.dsp_secs : 0.0, result.load.max * 100.0f,
+                    path.string().c_str());
+        if (result.underruns > 0)
+            std::printf("  %llu sampler underruns\n", static_cast<unsigned long long>(result.underruns));
+    }
+
+    // runs job indices over a few threads. each thread is dealt its own deque of jobs, takes from the
+    // front of it, and once it runs dry steals from the back of the others, so a thread that drew
+    // short melodies picks up the slack of one that drew long ones. jobs are whole-file renders
+    // lasting milliseconds to seconds, so a mutex per deque costs nothing next to them
+    class WorkStealingPool
+    {
+    public:
+        explicit WorkStealingPool(int num_threads) : queues(static_cast<std::size_t>(num_threads)) {}
+
+        // order is the preferred order of the jobs, longest first for the best balance
+        template <typename Body>
+        void run(const std::vector<int>& order, Body&& body)
+        {
+            for (std::size_t i = 0; i < order.size(); ++i)
+                queues[i % queues.size()].jobs.push_back(order[i]);
+
+            std::vector<std::thread> threads;
+            for (std::size_t t = 1; t < queues.size(); ++t)
+                threads.emplace_back([this, t, &body] { work(t, body); });
+            work(0, body);
+            for (auto& thread : threads)
+                thread.join();
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<int> jobs;
+        };
+
+        template <typename Body>
+        void work(std::size_t self, Body& body)
+        {
+            int job = 0;
+            while (take(self, job))
+                body(job);
+        }
+
+        bool take(std::size_t self, int& job)
+        {
+            {
+                Queue& own = queues[self];
+                std::lock_guard lock(own.mutex);
+                if (!own.jobs.empty())
+                {
+                    job = own.jobs.front();
+                    own.jobs.pop_front();
+                    return true;
+                }
+            }
+            // nothing is ever pushed after run() starts, so one empty pass means everything is taken
+            for (std::size_t i = 1; i < queues.size(); ++i)
+            {
+                Queue& victim = queues[(self + i) % queues.size()];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.jobs.empty())
+                {
+                    job = victim.jobs.back();
+                    victim.jobs.pop_back();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::vector<Queue> queues;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    if (!parseArgs(argc, argv, settings))
+    {
+        usage();
+        return 1;
+    }
+
+    if (settings.rt_check && !rtcheck::enabled)
+    {
+        std::fprintf(stderr, "--rt-check needs a build configured with -DSYNTH_RT_CHECK=ON\n");
+        return 1;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(settings.out_dir, error);
+
+    const auto note_map = keyboardNoteMap();
+    const auto catalog = melodyCatalog();
+    struct Source
+    {
+        std::string name;
+        double tempo = 1.0;
+        int transpose = 0;
+        const CompiledScore* score = nullptr;
+        std::string midi_path;
+    };
+    std::deque<CompiledScore> scores; // stable addresses for the jobs
+    std::vector<Source> sources;
+    bool ok = true;
+
+    for (const auto& wanted : settings.melodies)
+    {
+        bool found = false;
+        for (const auto& melody : catalog)
+        {
+            if (wanted != "all" && wanted != melody.name)
+                continue;
+            found = true;
+            scores.emplace_back(melody.notes, note_map);
+            sources.push_back({ melody.name, melody.tempo * settings.tempo, melody.transpose + settings.transpose, &scores.back(), {} });
+        }
+        if (!found)
+        {
+            std::fprintf(stderr, "unknown melody %s\n", wanted.c_str());
+            ok = false;
+        }
+    }
+
+    for (const auto& path : settings.score_files)
+    {
+        std::vector<MelodyNote> notes;
+        if (!readScoreFile(path, notes))
+        {
+            std::fprintf(stderr, "can't read score %s\n", path.c_str());
+            ok = false;
+            continue;
+        }
+        scores.emplace_back(notes, note_map);
+        sources.push_back({ std::filesystem::path(path).stem().string(), settings.tempo, settings.transpose, &scores.back(), {} });
+    }
+
+    // only checked for being there; they are read while they play
+    for (const auto& path : settings.midi_files)
+    {
+        if (!std::filesystem::is_regular_file(path, error))
+        {
+            std::fprintf(stderr, "can't read MIDI file %s\n", path.c_str());
+            ok = false;
+            continue;
+        }
+        sources.push_back({ std::filesystem::path(path).stem().string(), settings.tempo, settings.transpose, nullptr, path });
+    }
+
+    // shared by every job; each engine streams it with a prefetch thread of its own
+    SampleSet samples;
+    if (!settings.samples_dir.empty() && !samples.addDirectory(settings.samples_dir))
+    {
+        std::fprintf(stderr, "%s\n", samples.error().c_str());
+        ok = false;
+    }
+
+    // a melody rendered once keeps its plain name; a batch, or several waveforms or rates, spells out
+    // what each file is so none of them overwrites another
+    const bool spell_out = settings.batch || settings.waveforms.size() * settings.sample_rates.size() > 1;
+    std::vector<Job> jobs;
+    for (const Source& source : sources)
+    {
+        for (double sample_rate : settings.sample_rates)
+        {
+            for (WaveformType waveform : settings.waveforms)
+            {
+                std::string name = source.name;
+                if (spell_out)
+                    name += "_" + std::string(waveformName(waveform)) + "_" + std::to_string(static_cast<int>(sample_rate));
+                jobs.push_back({ std::move(name), source.score, source.midi_path, source.tempo, source.transpose, waveform, sample_rate });
+            }
+        }
+    }
+
+    const int num_threads = settings.batch ? std::min(settings.jobs, std::max(1, static_cast<int>(jobs.size()))) : 1;
+    std::printf("simd: %s, block %d, %d render threads, %zu jobs on %d threads\n", simd::isa_name,
+                settings.block_size, settings.render_threads, jobs.size(), num_threads);
+
+    // longest renders first, so none of them is left to run alone at the end. a MIDI file's length
+    // isn't known until it has played, so those go first of all
+    std::vector<int> order(jobs.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+        order[i] = static_cast<int>(i);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        const auto cost = [&](int i) {
+            const double length = jobs[i].score != nullptr ? jobs[i].score->lengthSecs() : 1e9;
+            return length / jobs[i].tempo * jobs[i].sample_rate;
+        };
+        return cost(a) > cost(b);
+    });
+
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    std::vector<JobResult> results(jobs.size());
+    WorkStealingPool(num_threads).run(order, [&](int job) { results[job] = bounce(jobs[job], settings, samples.empty() ? nullptr : &samples); });
+    const double wall_secs = std::chrono::duration<double>(clock::now() - start).count();
+
+    // reported in job order once everything is done, so the log reads the same for any thread count
+    double audio_secs = 0.0;
+    double dsp_secs = 0.0;
+    for (std::size_t i = 0; i < jobs.size(); ++i)
+    {
+        ok &= results[i].ok;
+        if (!results[i].ok)
+            continue;
+        printResult(jobs[i], results[i], settings);
+        audio_secs += results[i].audio_secs;
+        dsp_secs += results[i].dsp_secs;
+    }
+    std::printf("%zu files, %.2f s audio, %.2f s dsp, %.2f s wall, %.1fx real time overall\n", jobs.size(),
+                audio_secs, dsp_secs, wall_secs, wall_secs > 0.0 ? audio_secs / wall_secs : 0.0);
+
+    if (rtcheck::enabled)
+    {
+        const uint64_t violations = rtcheck::violations();
+        std::printf("rt-check: %llu real-time violations\n", static_cast<unsigned long long>(violations));
+        if (settings.rt_check && violations > 0)
+            ok = false;
+    }
+    return ok ? 0 : 1;
+}